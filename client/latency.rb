@@ -0,0 +1,75 @@
+#!/usr/bin/env ruby
+
+# usage: latency.rb [port] [rate] [seconds] [connections]
+#   rate 0 sends back to back on each connection.
+
+require 'socket'
+
+port = (ARGV[0] || 10080).to_i
+rate = (ARGV[1] || 100).to_f
+seconds = (ARGV[2] || 5).to_f
+connections = (ARGV[3] || 1).to_i
+
+REQUEST = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+
+def monotonic
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def connect(port)
+  sock = TCPSocket.new('localhost', port)
+  sock.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+  sock
+end
+
+# returns nil when the server has closed the keep-alive connection.
+def exchange(sock)
+  sock.write(REQUEST)
+  length = 0
+  while (line = sock.gets("\r\n")) != "\r\n"
+    return nil if line.nil?
+    length = $1.to_i if line =~ /\Acontent-length:\s*(\d+)/i
+  end
+  sock.read(length)
+rescue Errno::EPIPE, Errno::ECONNRESET
+  nil
+end
+
+samples = Queue.new
+stop = monotonic + seconds
+interval = rate > 0 ? connections / rate : 0
+
+threads = (1 .. connections).map do
+  Thread.new do
+    sock = connect(port)
+    slot = monotonic
+    while (t0 = monotonic) < stop
+      unless exchange(sock)
+        sock.close
+        sock = connect(port)
+        next
+      end
+      samples << monotonic - t0
+      next if interval.zero?
+      slot += interval
+      pause = slot - monotonic
+      sleep(pause) if pause > 0
+    end
+    sock.close
+  end
+end
+threads.each(&:join)
+
+latency = []
+latency << samples.pop until samples.empty?
+latency.sort!
+abort 'no samples' if latency.empty?
+
+def percentile(sorted, p)
+  sorted[[(sorted.size * p).ceil - 1, 0].max] * 1e6
+end
+
+printf("requests %d (%.0f/s)\n", latency.size, latency.size / seconds)
+printf("p50 %.0fus p90 %.0fus p99 %.0fus max %.0fus\n",
+  percentile(latency, 0.50), percentile(latency, 0.90),
+  percentile(latency, 0.99), latency.last * 1e6)
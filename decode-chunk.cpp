@@ -1,7 +1,8 @@
 #include <string>
+#include <algorithm>
 #include <cctype>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
 
 namespace http {
 
@@ -77,57 +78,110 @@ decoder_chunk_type::partial () const
     return 1 <= next_state && next_state <= 27;
 }
 
+// the classes are the SHIFT columns; TCHAR, QDTEXT and VCHAR are the
+// sets of them the grammar names.  in S12 every octet counts as VCH
+// until the chunk is full.
+enum {MATCH, VCH, TCH, ZERO, HEX, SEMI, EQUAL, COLON, WS, BSLASH, DQUOTE, CR, LF, NCLASS};
+
+constexpr uint32_t TCHAR = dfa_mask (TCH, ZERO, HEX);
+constexpr uint32_t QDTEXT = TCHAR | dfa_mask (VCH, SEMI, EQUAL, COLON, WS);
+constexpr uint32_t VCHAR = QDTEXT | dfa_mask (BSLASH, DQUOTE);
+
+constexpr dfa_class_type CLASSES[] = {
+    {"00", ZERO}, {"19AFaf", HEX}, {";;", SEMI}, {"==", EQUAL}, {"::", COLON},
+    {"\t\t  ", WS}, {"\\\\", BSLASH}, {"\"\"", DQUOTE}, {"\r\r", CR}, {"\n\n", LF},
+    {"!!#'*+-.09AZ^z||~~", TCH}, {"!~", VCH},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {1, dfa_mask (ZERO), 2}, {1, dfa_mask (HEX), 3},
+    {2, dfa_mask (ZERO), 2}, {2, dfa_mask (HEX), 3}, {2, dfa_mask (SEMI), 14}, {2, dfa_mask (CR), 21},
+    {3, dfa_mask (ZERO, HEX), 3}, {3, dfa_mask (SEMI), 4}, {3, dfa_mask (CR), 11},
+    {4, TCHAR, 5},
+    {5, TCHAR, 5}, {5, dfa_mask (SEMI), 4}, {5, dfa_mask (EQUAL), 6}, {5, dfa_mask (CR), 11},
+    {6, TCHAR, 7}, {6, dfa_mask (DQUOTE), 9},
+    {7, TCHAR, 7}, {7, dfa_mask (SEMI), 4}, {7, dfa_mask (CR), 11},
+    {8, VCHAR, 9},
+    {9, QDTEXT, 9}, {9, dfa_mask (BSLASH), 8}, {9, dfa_mask (DQUOTE), 10},
+    {10, dfa_mask (SEMI), 4}, {10, dfa_mask (CR), 11},
+    {11, dfa_mask (LF), 12},
+    {12, dfa_mask (VCH), 12}, {12, dfa_mask (CR), 13},
+    {13, dfa_mask (LF), 1},
+    {14, TCHAR, 15},
+    {15, TCHAR, 15}, {15, dfa_mask (SEMI), 14}, {15, dfa_mask (EQUAL), 16}, {15, dfa_mask (CR), 21},
+    {16, TCHAR, 17}, {16, dfa_mask (DQUOTE), 19},
+    {17, TCHAR, 17}, {17, dfa_mask (SEMI), 14}, {17, dfa_mask (CR), 21},
+    {18, VCHAR, 19},
+    {19, QDTEXT, 19}, {19, dfa_mask (BSLASH), 18}, {19, dfa_mask (DQUOTE), 20},
+    {20, dfa_mask (SEMI), 14}, {20, dfa_mask (CR), 21},
+    {21, dfa_mask (LF), 22},
+    {22, TCHAR, 23}, {22, dfa_mask (CR), 27},
+    {23, TCHAR, 23}, {23, dfa_mask (COLON), 24},
+    {24, VCHAR, 24}, {24, dfa_mask (CR), 25},
+    {25, dfa_mask (LF), 26},
+    {26, TCHAR, 23}, {26, dfa_mask (WS), 24}, {26, dfa_mask (CR), 27},
+    {27, dfa_mask (LF), 28},
+    {28, dfa_mask (MATCH), 1},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<29, NCLASS> SHIFT = dfa_shift_table<29, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int HAND_SHIFT[29][13] = {
+//     vch tch  0  HEX  ;   =   :  WS  \\   "  \r  \n
+    {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
+    {0, 0,  0,  2,  3,  0,  0,  0,  0,  0,  0,  0,  0}, // S1
+    {0, 0,  0,  2,  3, 14,  0,  0,  0,  0,  0, 21,  0}, // S2
+    {0, 0,  0,  3,  3,  4,  0,  0,  0,  0,  0, 11,  0}, // S3
+    {0, 0,  5,  5,  5,  0,  0,  0,  0,  0,  0,  0,  0}, // S4
+    {0, 0,  5,  5,  5,  4,  6,  0,  0,  0,  0, 11,  0}, // S5
+    {0, 0,  7,  7,  7,  0,  0,  0,  0,  0,  9,  0,  0}, // S6
+    {0, 0,  7,  7,  7,  4,  0,  0,  0,  0,  0, 11,  0}, // S7
+    {0, 9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  0,  0}, // S8
+    {0, 9,  9,  9,  9,  9,  9,  9,  9,  8, 10,  0,  0}, // S9
+    {0, 0,  0,  0,  0,  4,  0,  0,  0,  0,  0, 11,  0}, // S10
+    {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 12}, // S11
+    {0,12,  0,  0,  0,  0,  0,  0,  0,  0,  0, 13,  0}, // S12
+    {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1}, // S13
+    {0, 0, 15, 15, 15,  0,  0,  0,  0,  0,  0,  0,  0}, // S14
+    {0, 0, 15, 15, 15, 14, 16,  0,  0,  0,  0, 21,  0}, // S15
+    {0, 0, 17, 17, 17,  0,  0,  0,  0,  0, 19,  0,  0}, // S16
+    {0, 0, 17, 17, 17, 14,  0,  0,  0,  0,  0, 21,  0}, // S17
+    {0,19, 19, 19, 19, 19, 19, 19, 19, 19, 19,  0,  0}, // S18
+    {0,19, 19, 19, 19, 19, 19, 19, 19, 18, 20,  0,  0}, // S19
+    {0, 0,  0,  0,  0, 14,  0,  0,  0,  0,  0, 21,  0}, // S20
+    {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 22}, // S21
+    {0, 0, 23, 23, 23,  0,  0,  0,  0,  0,  0, 27,  0}, // S22
+    {0, 0, 23, 23, 23,  0,  0, 24,  0,  0,  0,  0,  0}, // S23
+    {0,24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 25,  0}, // S24
+    {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 26}, // S25
+    {0, 0, 23, 23, 23,  0,  0,  0, 24,  0,  0, 27,  0}, // S26
+    {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 28}, // S27
+    {1, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0}, // S28
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r                          
+    0x00000000, 0x08c00b00, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x82a22222, 0x11221221, 0x34444444, 0x44751611,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x14444442, 0x22222222, 0x22222222, 0x22219122,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x24444442, 0x22222222, 0x22222222, 0x22212120,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "chunk classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "chunk transitions");
+
 bool
 decoder_chunk_type::put (int const octet, std::string& body)
 {
-    static const int SHIFT[29][13] = {
-    //     vch tch  0  HEX  ;   =   :  WS  \\   "  \r  \n
-        {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0},
-        {0, 0,  0,  2,  3,  0,  0,  0,  0,  0,  0,  0,  0}, // S1
-        {0, 0,  0,  2,  3, 14,  0,  0,  0,  0,  0, 21,  0}, // S2
-        {0, 0,  0,  3,  3,  4,  0,  0,  0,  0,  0, 11,  0}, // S3
-        {0, 0,  5,  5,  5,  0,  0,  0,  0,  0,  0,  0,  0}, // S4
-        {0, 0,  5,  5,  5,  4,  6,  0,  0,  0,  0, 11,  0}, // S5
-        {0, 0,  7,  7,  7,  0,  0,  0,  0,  0,  9,  0,  0}, // S6
-        {0, 0,  7,  7,  7,  4,  0,  0,  0,  0,  0, 11,  0}, // S7
-        {0, 9,  9,  9,  9,  9,  9,  9,  9,  9,  9,  0,  0}, // S8
-        {0, 9,  9,  9,  9,  9,  9,  9,  9,  8, 10,  0,  0}, // S9
-        {0, 0,  0,  0,  0,  4,  0,  0,  0,  0,  0, 11,  0}, // S10
-        {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 12}, // S11
-        {0,12,  0,  0,  0,  0,  0,  0,  0,  0,  0, 13,  0}, // S12
-        {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1}, // S13
-        {0, 0, 15, 15, 15,  0,  0,  0,  0,  0,  0,  0,  0}, // S14
-        {0, 0, 15, 15, 15, 14, 16,  0,  0,  0,  0, 21,  0}, // S15
-        {0, 0, 17, 17, 17,  0,  0,  0,  0,  0, 19,  0,  0}, // S16
-        {0, 0, 17, 17, 17, 14,  0,  0,  0,  0,  0, 21,  0}, // S17
-        {0,19, 19, 19, 19, 19, 19, 19, 19, 19, 19,  0,  0}, // S18
-        {0,19, 19, 19, 19, 19, 19, 19, 19, 18, 20,  0,  0}, // S19
-        {0, 0,  0,  0,  0, 14,  0,  0,  0,  0,  0, 21,  0}, // S20
-        {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 22}, // S21
-        {0, 0, 23, 23, 23,  0,  0,  0,  0,  0,  0, 27,  0}, // S22
-        {0, 0, 23, 23, 23,  0,  0, 24,  0,  0,  0,  0,  0}, // S23
-        {0,24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 25,  0}, // S24
-        {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 26}, // S25
-        {0, 0, 23, 23, 23,  0,  0,  0, 24,  0,  0, 27,  0}, // S26
-        {0, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 28}, // S27
-        {1, 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0}, // S28
-    };
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r                          
-        0x00000000, 0x08c00b00, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x82a22222, 0x11221221, 0x34444444, 0x44751611,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x14444442, 0x22222222, 0x22222222, 0x22219122,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x24444442, 0x22222222, 0x22222222, 0x22212120,
-    };
     if (! partial ())
         return false;
     int prev_state = next_state;
-    int cls = lookup_cls (CCLASS, octet);
+    int cls = CCLASS (octet);
     if (12 == prev_state && --chunk_size >= 0)
-        cls = 1;
+        cls = VCH;
     next_state = 0 == cls ? 0 : SHIFT[prev_state][cls];
     if (! next_state)
         return false;
@@ -143,11 +197,33 @@ decoder_chunk_type::put (int const octet, std::string& body)
               : octet >= 'A' ? octet - 'A' + 10
               : octet - '0');
     }
-    if (12 == prev_state && 1 == cls) {
+    if (12 == prev_state && VCH == cls) {
         body.push_back (octet);
         ++content_length;
     }
     return partial ();
 }
 
+// same as putting the octets one at a time until the body is decided,
+// and returns how many were taken.  chunk-data is appended a run at a
+// time; the state table sees only the chunk-size lines, the CRLF after
+// each chunk and the trailer.
+std::size_t
+decoder_chunk_type::put (char const* p, std::size_t const n, std::string& body)
+{
+    std::size_t i = 0;
+    while (i < n && partial ()) {
+        if (12 == next_state && chunk_size > 0) {
+            std::size_t const m = std::min<std::size_t> (n - i, chunk_size);
+            body.append (p + i, m);
+            content_length += m;
+            chunk_size -= m;
+            i += m;
+        }
+        else
+            put (static_cast<uint8_t> (p[i++]), body);
+    }
+    return i;
+}
+
 }// namespace http
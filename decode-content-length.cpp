@@ -1,7 +1,8 @@
 #include <string>
 #include <cctype>
+#include <limits>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
 
 namespace http {
 
@@ -11,28 +12,50 @@ namespace http {
 // S4: [0-9] S2 | [,] S4 | [\t ] S4 | $ S5
 // S5: MATCH
 
+enum {MATCH, DIGIT, COMMA, WS, END, NCLASS};
+
+constexpr dfa_class_type CLASSES[] = {
+    {"09", DIGIT}, {",,", COMMA}, {"\t\t  ", WS},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {1, dfa_mask (DIGIT), 0x12}, {1, dfa_mask (COMMA, WS), 0x01},
+    {2, dfa_mask (DIGIT), 0x12}, {2, dfa_mask (COMMA), 0x24}, {2, dfa_mask (WS), 0x23},
+    {2, dfa_mask (END), 0x25},
+    {3, dfa_mask (COMMA), 0x04}, {3, dfa_mask (WS), 0x03}, {3, dfa_mask (END), 0x05},
+    {4, dfa_mask (DIGIT), 0x12}, {4, dfa_mask (COMMA, WS), 0x04}, {4, dfa_mask (END), 0x05},
+    {5, dfa_mask (MATCH), 1},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<6, NCLASS> SHIFT = dfa_shift_table<6, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int8_t HAND_SHIFT[6][5] = {
+//      [0-9] [,]   [\t ] $
+    {0, 0x00, 0x00, 0x00, 0x00},
+    {0, 0x12, 0x01, 0x01, 0x00}, // S1
+    {0, 0x12, 0x24, 0x23, 0x25}, // S2
+    {0, 0x00, 0x04, 0x03, 0x05}, // S3
+    {0, 0x12, 0x04, 0x04, 0x05}, // S4
+    {1, 0x00, 0x00, 0x00, 0x00}, // S5
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r                          
+    0x00000000, 0x03000000, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x30000000, 0x00002000, 0x11111111, 0x11000000,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "content length classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "content length transitions");
+
 bool
 decode (content_length_type& field, std::string const& src)
 {
-    static const int8_t SHIFT[6][5] = {
-    //      [0-9] [,]   [\t ] $
-        {0, 0x00, 0x00, 0x00, 0x00},
-        {0, 0x12, 0x01, 0x01, 0x00}, // S1
-        {0, 0x12, 0x24, 0x23, 0x25}, // S2
-        {0, 0x00, 0x04, 0x03, 0x05}, // S3
-        {0, 0x12, 0x04, 0x04, 0x05}, // S4
-        {1, 0x00, 0x00, 0x00, 0x00}, // S5
-    };
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r                          
-        0x00000000, 0x03000000, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x30000000, 0x00002000, 0x11111111, 0x11000000,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x00000000, 0x00000000, 0x00000000, 0x00000000,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x00000000, 0x00000000, 0x00000000, 0x00000000,
-    };
     std::string::const_iterator s = src.cbegin ();
     std::string::const_iterator const e = src.cend ();
     ssize_t length = -1;
@@ -42,15 +65,15 @@ decode (content_length_type& field, std::string const& src)
     bool matched = false;
     for (int next_state = 1; s <= e; ++s) {
         uint32_t octet = s == e ? '\0' : static_cast<uint8_t> (*s);
-        int cls = s == e ? 4 : lookup_cls (CCLASS, octet);
+        int cls = s == e ? END : CCLASS (octet);
         int prev_state = next_state;
         next_state = ! cls ? 0 : SHIFT[prev_state][cls] & 0x0f;
         if (! next_state)
             break;
         switch (SHIFT[prev_state][cls] & 0xf0) {
         case 0x10:
-            // 214748364L * 10 + 7 == 0x7fffffffL
-            if (value > 214748364L || (value == 214748364L && octet > '7')) {
+            // the length must fit ssize_t: value * 10 + digit <= max.
+            if (value > (std::numeric_limits<ssize_t>::max () - (octet - '0')) / 10) {
                 field.status = 413;
                 return false;
             }
@@ -0,0 +1,137 @@
+#ifndef DECODE_DFA_HPP
+#define DECODE_DFA_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+
+// compile-time construction of the decoders' state tables from the
+// grammar.  a decoder lists its character classes as lo hi octet pairs,
+// as for scan_set_type, the first class holding an octet naming it, and
+// its transitions as the grammar comments read them: from a state, on
+// any class of a mask, to the next state with the action bits or'ed in.
+// class 0 is MATCH, the column the final states set to 1.
+
+struct dfa_class_type {
+    char const* pairs;
+    int cls;
+};
+
+struct dfa_edge_type {
+    int state;
+    uint32_t mask;
+    int next;
+};
+
+constexpr uint32_t
+dfa_mask ()
+{
+    return 0;
+}
+
+template<class... T>
+constexpr uint32_t
+dfa_mask (int const cls, T... rest)
+{
+    return uint32_t (1) << cls | dfa_mask (rest...);
+}
+
+// octet classes indexed by the octet itself; everything outside the
+// listed classes, and anything not an octet, is class 0.
+struct dfa_octet_table_type {
+    uint8_t cls[256];
+    int operator () (uint32_t const octet) const { return octet < 256 ? cls[octet] : 0; }
+};
+
+// the transitions flattened to one row of NC columns per state.
+template<std::size_t NS, std::size_t NC>
+struct dfa_shift_table_type {
+    uint8_t next[NS * NC];
+    uint8_t const* operator [] (int const state) const { return next + state * NC; }
+};
+
+template<std::size_t... I> struct dfa_indices {};
+
+template<std::size_t N, std::size_t... I>
+struct dfa_make_indices : dfa_make_indices<N - 1, N - 1, I...> {};
+
+template<std::size_t... I>
+struct dfa_make_indices<0, I...> { typedef dfa_indices<I...> type; };
+
+constexpr bool
+dfa_in_pairs (char const* p, uint32_t const octet)
+{
+    return '\0' != p[0]
+        && ((uint8_t (p[0]) <= octet && octet <= uint8_t (p[1]))
+            || dfa_in_pairs (p + 2, octet));
+}
+
+template<std::size_t N>
+constexpr int
+dfa_classify (dfa_class_type const (&spec)[N], uint32_t const octet, std::size_t const k = 0)
+{
+    return k == N ? 0
+         : dfa_in_pairs (spec[k].pairs, octet) ? spec[k].cls
+         : dfa_classify (spec, octet, k + 1);
+}
+
+template<std::size_t M>
+constexpr int
+dfa_next (dfa_edge_type const (&edge)[M], int const state, int const cls, std::size_t const k = 0)
+{
+    return k == M ? 0
+         : edge[k].state == state && (edge[k].mask >> cls & 1) ? edge[k].next
+         : dfa_next (edge, state, cls, k + 1);
+}
+
+template<std::size_t N, std::size_t... I>
+constexpr dfa_octet_table_type
+dfa_octet_table (dfa_class_type const (&spec)[N], dfa_indices<I...>)
+{
+    return dfa_octet_table_type {{uint8_t (dfa_classify (spec, I))...}};
+}
+
+template<std::size_t N>
+constexpr dfa_octet_table_type
+dfa_octet_table (dfa_class_type const (&spec)[N])
+{
+    return dfa_octet_table (spec, typename dfa_make_indices<256>::type ());
+}
+
+template<std::size_t NS, std::size_t NC, std::size_t M, std::size_t... I>
+constexpr dfa_shift_table_type<NS, NC>
+dfa_shift_table (dfa_edge_type const (&edge)[M], dfa_indices<I...>)
+{
+    return dfa_shift_table_type<NS, NC> {{uint8_t (dfa_next (edge, I / NC, I % NC))...}};
+}
+
+template<std::size_t NS, std::size_t NC, std::size_t M>
+constexpr dfa_shift_table_type<NS, NC>
+dfa_shift_table (dfa_edge_type const (&edge)[M])
+{
+    return dfa_shift_table<NS, NC> (edge, typename dfa_make_indices<NS * NC>::type ());
+}
+
+// checks against the hand-compiled tables: sixteen words of eight
+// nibbles for the octets below 0x80, and a SHIFT[state][cls] array.
+constexpr bool
+dfa_same_class (dfa_octet_table_type const& t, uint32_t const (&packed)[16], uint32_t const octet = 0)
+{
+    return 256 == octet
+        || ((octet < 128 ? packed[octet >> 3] >> ((7 - (octet & 7)) << 2) & 15 : 0) == t.cls[octet]
+            && dfa_same_class (t, packed, octet + 1));
+}
+
+template<std::size_t NS, std::size_t NC, class T, std::size_t LS, std::size_t LC>
+constexpr bool
+dfa_same_shift (dfa_shift_table_type<NS, NC> const& t, T const (&shift)[LS][LC], std::size_t const i = 0)
+{
+    return LS * LC == i
+        || (shift[i / LC][i % LC] == (i / LC < NS && i % LC < NC ? t.next[i / LC * NC + i % LC] : 0)
+            && dfa_same_shift (t, shift, i + 1));
+}
+
+}//namespace http
+
+#endif
@@ -1,6 +1,6 @@
 #include <string>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
 
 namespace http {
 
@@ -14,32 +14,60 @@ namespace http {
 // S8: [\t ] S8 | $ S9
 // S9: MATCH
 
+enum {MATCH, QCH, WEAK, SLASH, DQUOTE, STAR, COMMA, WS, END, NCLASS};
+
+constexpr dfa_class_type CLASSES[] = {
+    {"WW", WEAK}, {"//", SLASH}, {"\"\"", DQUOTE}, {"**", STAR}, {",,", COMMA},
+    {"\t\t  ", WS}, {"!~", QCH},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {1, dfa_mask (WEAK), 0x13}, {1, dfa_mask (DQUOTE), 0x25}, {1, dfa_mask (STAR), 0x38},
+    {1, dfa_mask (COMMA), 0x02}, {1, dfa_mask (WS), 0x01},
+    {2, dfa_mask (WEAK), 0x13}, {2, dfa_mask (DQUOTE), 0x25}, {2, dfa_mask (COMMA, WS), 0x02},
+    {3, dfa_mask (SLASH), 0x04},
+    {4, dfa_mask (DQUOTE), 0x25},
+    {5, dfa_mask (QCH, WEAK, SLASH, STAR, COMMA), 0x25}, {5, dfa_mask (DQUOTE), 0x36},
+    {6, dfa_mask (COMMA), 0x07}, {6, dfa_mask (WS), 0x06}, {6, dfa_mask (END), 0x09},
+    {7, dfa_mask (WEAK), 0x13}, {7, dfa_mask (DQUOTE), 0x25}, {7, dfa_mask (COMMA, WS), 0x07},
+    {7, dfa_mask (END), 0x09},
+    {8, dfa_mask (WS), 0x08}, {8, dfa_mask (END), 0x09},
+    {9, dfa_mask (MATCH), 1},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<10, NCLASS> SHIFT = dfa_shift_table<10, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int HAND_SHIFT[10][9] = {
+//      qch   [W]   [/]   ["]   [*]   [,]   [\t ] $
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0, 0x00, 0x13, 0x00, 0x25, 0x38, 0x02, 0x01, 0x00}, // S1
+    {0, 0x00, 0x13, 0x00, 0x25, 0x00, 0x02, 0x02, 0x00}, // S2
+    {0, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00}, // S3
+    {0, 0x00, 0x00, 0x00, 0x25, 0x00, 0x00, 0x00, 0x00}, // S4
+    {0, 0x25, 0x25, 0x25, 0x36, 0x25, 0x25, 0x00, 0x00}, // S5
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x06, 0x09}, // S6
+    {0, 0x00, 0x13, 0x00, 0x25, 0x00, 0x07, 0x07, 0x09}, // S7
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x09}, // S8
+    {1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // S9
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r                          
+    0x00000000, 0x07000000, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x71411111, 0x11516113, 0x11111111, 0x11111111,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x11111111, 0x11111111, 0x11111112, 0x11111111,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x11111111, 0x11111111, 0x11111111, 0x11111110,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "etag classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "etag transitions");
+
 bool
 decode (std::vector<etag_type>& fields, std::string const& src)
 {
-    static const int SHIFT[10][9] = {
-    //      qch   [W]   [/]   ["]   [*]   [,]   [\t ] $
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        {0, 0x00, 0x13, 0x00, 0x25, 0x38, 0x02, 0x01, 0x00}, // S1
-        {0, 0x00, 0x13, 0x00, 0x25, 0x00, 0x02, 0x02, 0x00}, // S2
-        {0, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00}, // S3
-        {0, 0x00, 0x00, 0x00, 0x25, 0x00, 0x00, 0x00, 0x00}, // S4
-        {0, 0x25, 0x25, 0x25, 0x36, 0x25, 0x25, 0x00, 0x00}, // S5
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x06, 0x09}, // S6
-        {0, 0x00, 0x13, 0x00, 0x25, 0x00, 0x07, 0x07, 0x09}, // S7
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x09}, // S8
-        {1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // S9
-    };
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r                          
-        0x00000000, 0x07000000, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x71411111, 0x11516113, 0x11111111, 0x11111111,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x11111111, 0x11111111, 0x11111112, 0x11111111,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x11111111, 0x11111111, 0x11111111, 0x11111110,
-    };
     std::string::const_iterator s = src.cbegin ();
     std::string::const_iterator const e = src.cend ();
     std::vector<etag_type> list;
@@ -47,7 +75,7 @@ decode (std::vector<etag_type>& fields, std::string const& src)
     bool matched = false;    
     for (int next_state = 1; s <= e; ++s) {
         uint32_t octet = s == e ? '\0' : static_cast<uint8_t> (*s);
-        int cls = s == e ? 8 : lookup_cls (CCLASS, octet);
+        int cls = s == e ? END : CCLASS (octet);
         int prev_state = next_state;
         next_state = ! cls ? 0 : (SHIFT[prev_state][cls] & 0x0f);
         if (! next_state)
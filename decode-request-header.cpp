@@ -1,12 +1,14 @@
 #include <string>
+#include <algorithm>
 #include <cctype>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
+#include "decode-scan.hpp"
 
 namespace http {
 
 decoder_request_header_type::decoder_request_header_type ()
-    : next_state (1), name (), value (), nfield (0), nbyte (0),
+    : next_state (1), nfield (0), nbyte (0),
       limit_nfield (100), limit_nbyte (8190)
 {
 }
@@ -15,9 +17,6 @@ void
 decoder_request_header_type::clear ()
 {
     next_state = 1;
-    name.clear ();
-    value.clear ();
-    spaces.clear ();
     nfield = 0;
     nbyte = 0;
 }
@@ -49,70 +48,135 @@ decoder_request_header_type::partial () const
 // S7: [\n] S8
 // S8: MATCH
 
+// VCHAR is the set of classes the grammar calls vchar.
+enum {MATCH, VCH, COLON, TCH, WS, CR, LF, NCLASS};
+
+constexpr uint32_t VCHAR = dfa_mask (VCH, COLON, TCH);
+
+constexpr dfa_class_type CLASSES[] = {
+    {"::", COLON}, {"!!#'*+-.09AZ^z||~~", TCH}, {"\t\t  ", WS}, {"\r\r", CR}, {"\n\n", LF},
+    {"!~", VCH},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {1, dfa_mask (TCH), 0x12}, {1, dfa_mask (CR), 0x07},
+    {2, dfa_mask (COLON), 0x03}, {2, dfa_mask (TCH), 0x12},
+    {3, VCHAR, 0x24}, {3, dfa_mask (WS), 0x03}, {3, dfa_mask (CR), 0x05},
+    {4, VCHAR, 0x24}, {4, dfa_mask (WS), 0x34}, {4, dfa_mask (CR), 0x05},
+    {5, dfa_mask (LF), 0x06},
+    {6, dfa_mask (VCH, COLON), 0x02}, {6, dfa_mask (TCH), 0x52}, {6, dfa_mask (WS), 0x43},
+    {6, dfa_mask (CR), 0x57},
+    {7, dfa_mask (LF), 0x08},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<9, NCLASS> SHIFT = dfa_shift_table<9, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int HAND_SHIFT[9][7] = {
+//      vch   [:]   tchar [\t ] [\r]  [\n]
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0, 0x00, 0x00, 0x12, 0x00, 0x07, 0x00}, // S1: tchar S2 | [\r] S7
+    {0, 0x00, 0x03, 0x12, 0x00, 0x00, 0x00}, // S2: tchar S2 | [:] S3
+    {0, 0x24, 0x24, 0x24, 0x03, 0x05, 0x00}, // S3: vchar S4 | [\t ] S3 | [\r] S5
+    {0, 0x24, 0x24, 0x24, 0x34, 0x05, 0x00}, // S4: vchar S4 | [\t ] S4 | [\r] S5
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06}, // S5: [\n] S6
+    {0, 0x02, 0x02, 0x52, 0x43, 0x57, 0x00}, // S6: vchar S2 | [\t ] S3 | [\r] S7
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08}, // S7: [\n] S8
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // S8: MATCH
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r                          
+    0x00000000, 0x04600500, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x43133333, 0x11331331, 0x33333333, 0x33211111,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x13333333, 0x33333333, 0x33333333, 0x33311133,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x33333333, 0x33333333, 0x33333333, 0x33313130,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "request header classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "request header transitions");
+
 bool
 decoder_request_header_type::put (uint32_t const octet, request_type& req)
 {
-    static const int SHIFT[9][7] = {
-    //      vch   [:]   tchar [\t ] [\r]  [\n]
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        {0, 0x00, 0x00, 0x12, 0x00, 0x07, 0x00}, // S1: tchar S2 | [\r] S7
-        {0, 0x00, 0x03, 0x12, 0x00, 0x00, 0x00}, // S2: tchar S2 | [:] S3
-        {0, 0x24, 0x24, 0x24, 0x03, 0x05, 0x00}, // S3: vchar S4 | [\t ] S3 | [\r] S5
-        {0, 0x24, 0x24, 0x24, 0x34, 0x05, 0x00}, // S4: vchar S4 | [\t ] S4 | [\r] S5
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06}, // S5: [\n] S6
-        {0, 0x02, 0x02, 0x52, 0x43, 0x57, 0x00}, // S6: vchar S2 | [\t ] S3 | [\r] S7
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08}, // S7: [\n] S8
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // S8: MATCH
-    };
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r                          
-        0x00000000, 0x04600500, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x43133333, 0x11331331, 0x33333333, 0x33211111,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x13333333, 0x33333333, 0x33333333, 0x33311133,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x33333333, 0x33333333, 0x33333333, 0x33313130,
-    };
     if (! partial ())
         return false;
     if (++nbyte > limit_nbyte)
         return failure ();
-    int cls = lookup_cls (CCLASS, octet);
+    int cls = CCLASS (octet);
     int prev_state = next_state;
     next_state = ! cls ? 0 : SHIFT[prev_state][cls] & 0x0f;
     if (! next_state)
         return false;
+    char const c = octet;
     switch (SHIFT[prev_state][cls] & 0xf0) {
     case 0x10:
-        name.push_back (std::tolower (octet));
+        req.header.put_name (&c, 1);
         break;
     case 0x20:
-        value.append (spaces);
-        value.push_back (octet);
-        spaces.clear ();
-        break;
     case 0x30:
-        spaces.push_back (octet);
+        req.header.put_value (&c, 1);
         break;
     case 0x40:
-        spaces = " ";
+        req.header.fold_value ();
         break;
     case 0x50:
         if (++nfield > limit_nfield)
             return failure ();
-        if (req.header.count (name) == 0)
-            req.header[name] = value;
-        else
-            req.header[name] += "," + value;
-        name.clear ();
-        value.clear ();
-        spaces.clear ();
-        name.push_back (std::tolower (octet));
+        req.header.close_field ();
+        if (TCH == cls)
+            req.header.put_name (&c, 1);
         nbyte = 0;
         break;
     }
     return partial ();
 }
 
+// same as putting the octets one at a time until the header is decided,
+// and returns how many were taken.  scan_span finds the runs that loop
+// on S2 (field-name) and on S3 or S4 (field-value), and each run goes
+// into the header map in one append; the octet that ends a run, CR, LF,
+// [:] or anything invalid, goes through the state table.
+std::size_t
+decoder_request_header_type::put (char const* p, std::size_t const n, request_type& req)
+{
+    static const scan_set_type TCHAR ("!!#'*+-.09AZ^z||");
+    static const scan_set_type FIELD ("\t\t ~");
+    std::size_t i = 0;
+    while (i < n && partial ()) {
+        if (2 <= next_state && next_state <= 4) {
+            std::size_t const room = std::min (n - i, limit_nbyte - nbyte);
+            std::size_t const m = scan_span (p + i, room, 2 == next_state ? TCHAR : FIELD);
+            if (2 == next_state)
+                req.header.put_name (p + i, m);
+            else
+                put_value (p + i, m, req);
+            nbyte += m;
+            i += m;
+            if (i == n)
+                break;
+        }
+        put (static_cast<uint8_t> (p[i++]), req);
+    }
+    return i;
+}
+
+// S3 drops blanks; S4 keeps them, and close_field trims those that
+// trail the value.
+void
+decoder_request_header_type::put_value (char const* p, std::size_t const n, request_type& req)
+{
+    std::size_t i = 0;
+    if (3 == next_state) {
+        while (i < n && (' ' == p[i] || '\t' == p[i]))
+            ++i;
+        if (i == n)
+            return;
+        next_state = 4;
+    }
+    req.header.put_value (p + i, n - i);
+}
+
 }// namespace http
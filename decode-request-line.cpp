@@ -1,7 +1,9 @@
 #include <string>
+#include <algorithm>
 #include <cctype>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
+#include "decode-scan.hpp"
 
 namespace http {
 
@@ -53,39 +55,79 @@ decoder_request_line_type::partial () const
 // [/] 5 pchar
 // [ ] 6
 
+// the method is told apart once, as the line leaves S2.
+static method_type
+method_id (std::string const& method)
+{
+    switch (method.size ()) {
+    case 3:
+        return method == "GET" ? METHOD_GET
+             : method == "PUT" ? METHOD_PUT
+             : METHOD_OTHER;
+    case 4:
+        return method == "HEAD" ? METHOD_HEAD
+             : method == "POST" ? METHOD_POST
+             : METHOD_OTHER;
+    }
+    return METHOD_OTHER;
+}
+
+// the classes are the numbered sets above.  the table covers S1 to S5;
+// from S6 on the version is matched against HTTPVERSION.
+enum {MATCH, TPCHR, TCHR, PCHR, STAR, SLASH, SP, NCLASS};
+
+constexpr dfa_class_type CLASSES[] = {
+    {"**", STAR}, {"//", SLASH}, {"  ", SP}, {"(),,:;==?@", PCHR}, {"##^^``||", TCHR},
+    {"!!$'++-.09AZ__az~~", TPCHR},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {1, dfa_mask (TPCHR, TCHR, STAR), 0x22},
+    {2, dfa_mask (TPCHR, TCHR, STAR), 0x22}, {2, dfa_mask (SP), 0x03},
+    {3, dfa_mask (STAR), 0x44}, {3, dfa_mask (SLASH), 0x45},
+    {4, dfa_mask (SP), 0x06},
+    {5, dfa_mask (TPCHR, PCHR, STAR, SLASH), 0x45}, {5, dfa_mask (SP), 0x06},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<6, NCLASS> SHIFT = dfa_shift_table<6, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int HAND_SHIFT[14][11] = {
+//      tpchr tchr  pchr  [*]   [/]   [ ]
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0, 0x22, 0x22, 0x00, 0x22, 0x00, 0x00}, // S1 tchar S2
+    {0, 0x22, 0x22, 0x00, 0x22, 0x00, 0x03}, // S2 tchar S2 | [ ] S3
+    {0, 0x00, 0x00, 0x00, 0x44, 0x45, 0x00}, // S3 [*] S4 | [/] S5
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06}, // S4 [ ] S6
+    {0, 0x45, 0x00, 0x45, 0x45, 0x45, 0x06}, // S5 pchar S5 | [ ] S6
+    // [H] [T] [T] [P] [/] [0-9] [.] [0-9] [\r] [\n] MATCH
+    // S6  S7  S8  S9  Sa  Sb    Sc  Sd    Se   Sf   S10
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x61021111, 0x33413115, 0x11111111, 0x11330303,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x31111111, 0x11111111, 0x11111111, 0x11100021,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x21111111, 0x11111111, 0x11111111, 0x11102010,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "request line classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "request line transitions");
+
 bool
 decoder_request_line_type::put (uint32_t const octet, request_type& req)
 {
-    static const int SHIFT[14][11] = {
-    //      tpchr tchr  pchr  [*]   [/]   [ ]
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        {0, 0x22, 0x22, 0x00, 0x22, 0x00, 0x00}, // S1 tchar S2
-        {0, 0x22, 0x22, 0x00, 0x22, 0x00, 0x03}, // S2 tchar S2 | [ ] S3
-        {0, 0x00, 0x00, 0x00, 0x44, 0x45, 0x00}, // S3 [*] S4 | [/] S5
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06}, // S4 [ ] S6
-        {0, 0x45, 0x00, 0x45, 0x45, 0x45, 0x06}, // S5 pchar S5 | [ ] S6
-        // [H] [T] [T] [P] [/] [0-9] [.] [0-9] [\r] [\n] MATCH
-        // S6  S7  S8  S9  Sa  Sb    Sc  Sd    Se   Sf   S10
-    };
     static const std::string HTTPVERSION ("HTTP/1.1\x0d\x0a");
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r
-        0x00000000, 0x00000000, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x61021111, 0x33413115, 0x11111111, 0x11330303,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x31111111, 0x11111111, 0x11111111, 0x11100021,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x21111111, 0x11111111, 0x11111111, 0x11102010,
-    };
     if (! partial ())
         return false;
     if (++nbyte > limit_nbyte)
         return failure ();
     int prev_state = next_state;
     if (prev_state <= 0x05) {
-        std::wstring  wsegment;
-        int cls = lookup_cls (CCLASS, octet);
+        int cls = CCLASS (octet);
         next_state = ! cls ? 0 : SHIFT[prev_state][cls] & 0x1f;
         switch (SHIFT[prev_state][cls] & 0xe0) {
         case 0x20:
@@ -95,6 +137,8 @@ decoder_request_line_type::put (uint32_t const octet, request_type& req)
             req.uri.push_back (octet);
             break;
         }
+        if (2 == prev_state && 3 == next_state)
+            req.method_id = method_id (req.method);
     }
     else if (prev_state <= 0x0f) {
         uint32_t k = static_cast<uint8_t> (HTTPVERSION[prev_state - 0x06]);
@@ -103,8 +147,38 @@ decoder_request_line_type::put (uint32_t const octet, request_type& req)
                    : 0;
         if (' ' < k)
             req.http_version.push_back (octet);
+        if (0x0b == prev_state)
+            req.version = (octet - '0') << 8;
+        else if (0x0d == prev_state)
+            req.version |= octet - '0';
     }
     return partial ();
 }
 
+// same as putting the octets one at a time until the line is decided,
+// and returns how many were taken.  runs of method and target octets
+// are found by scan_span and appended whole; only the octets that end
+// a run go through the state table.  the sets are the classes that loop
+// on S2 and S5, short of [~] for tchar, which goes the slow way.
+std::size_t
+decoder_request_line_type::put (char const* p, std::size_t const n, request_type& req)
+{
+    static const scan_set_type TCHAR ("!!#'*+-.09AZ^z||");
+    static const scan_set_type PCHAR ("!!$;==?Z__az~~");
+    std::size_t i = 0;
+    while (i < n && partial ()) {
+        if (2 == next_state || 5 == next_state) {
+            std::size_t const room = std::min (n - i, limit_nbyte - nbyte);
+            std::size_t const m = scan_span (p + i, room, 2 == next_state ? TCHAR : PCHAR);
+            (2 == next_state ? req.method : req.uri).append (p + i, m);
+            nbyte += m;
+            i += m;
+            if (i == n)
+                break;
+        }
+        put (static_cast<uint8_t> (p[i++]), req);
+    }
+    return i;
+}
+
 }// namespace http
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstring>
+#include "decode-scan.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace http {
+
+scan_set_type::scan_set_type (char const* pairs)
+    : range (), size (0), member ()
+{
+    std::size_t const n = std::min<std::size_t> (std::strlen (pairs), sizeof range) & ~1;
+    std::memcpy (range, pairs, n);
+    size = n;
+    for (std::size_t i = 0; i < n; i += 2)
+        for (uint32_t c = uint8_t (range[i]); c <= uint8_t (range[i + 1]); ++c)
+            member[c] = 1;
+}
+
+std::size_t
+scan_span_scalar (char const* p, std::size_t const n, scan_set_type const& set)
+{
+    std::size_t i = 0;
+    while (i < n && set.has (uint8_t (p[i])))
+        ++i;
+    return i;
+}
+
+#ifdef SCAN_X86
+
+bool
+scan_has_sse42 ()
+{
+    static bool const yes = __builtin_cpu_supports ("sse4.2");
+    return yes;
+}
+
+bool
+scan_has_avx2 ()
+{
+    static bool const yes = __builtin_cpu_supports ("avx2");
+    return yes;
+}
+
+// pcmpestri in ranges mode with negated polarity gives the index of the
+// first octet of 16 outside every range, or 16 when there is none.
+__attribute__ ((target ("sse4.2")))
+std::size_t
+scan_span_sse42 (char const* p, std::size_t const n, scan_set_type const& set)
+{
+    __m128i const ranges = _mm_loadu_si128 (reinterpret_cast<__m128i const*> (set.range));
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i const x = _mm_loadu_si128 (reinterpret_cast<__m128i const*> (p + i));
+        int const k = _mm_cmpestri (ranges, set.size, x, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES
+            | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+        if (k < 16)
+            return i + k;
+    }
+    return i + scan_span_scalar (p + i, n - i, set);
+}
+
+// an octet x lies in [lo, hi] when max (x, lo) and min (x, hi) both
+// equal x, compared unsigned so that octets above 0x7f stay outside.
+__attribute__ ((target ("avx2")))
+std::size_t
+scan_span_avx2 (char const* p, std::size_t const n, scan_set_type const& set)
+{
+    int const nrange = set.size / 2;
+    __m256i lo[8], hi[8];
+    for (int r = 0; r < nrange; ++r) {
+        lo[r] = _mm256_set1_epi8 (set.range[2 * r]);
+        hi[r] = _mm256_set1_epi8 (set.range[2 * r + 1]);
+    }
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i const x = _mm256_loadu_si256 (reinterpret_cast<__m256i const*> (p + i));
+        __m256i in = _mm256_setzero_si256 ();
+        for (int r = 0; r < nrange; ++r) {
+            __m256i const above = _mm256_cmpeq_epi8 (_mm256_max_epu8 (x, lo[r]), x);
+            __m256i const below = _mm256_cmpeq_epi8 (_mm256_min_epu8 (x, hi[r]), x);
+            in = _mm256_or_si256 (in, _mm256_and_si256 (above, below));
+        }
+        uint32_t const out = ~uint32_t (_mm256_movemask_epi8 (in));
+        if (out != 0)
+            return i + __builtin_ctz (out);
+    }
+    return i + scan_span_sse42 (p + i, n - i, set);
+}
+
+#else
+
+bool
+scan_has_sse42 ()
+{
+    return false;
+}
+
+bool
+scan_has_avx2 ()
+{
+    return false;
+}
+
+std::size_t
+scan_span_sse42 (char const* p, std::size_t const n, scan_set_type const& set)
+{
+    return scan_span_scalar (p, n, set);
+}
+
+std::size_t
+scan_span_avx2 (char const* p, std::size_t const n, scan_set_type const& set)
+{
+    return scan_span_scalar (p, n, set);
+}
+
+#endif
+
+std::size_t
+scan_span (char const* p, std::size_t const n, scan_set_type const& set)
+{
+    typedef std::size_t (*scan_type) (char const*, std::size_t const, scan_set_type const&);
+    static scan_type const scan = scan_has_avx2 () ? scan_span_avx2
+                                : scan_has_sse42 () ? scan_span_sse42
+                                : scan_span_scalar;
+    return scan (p, n, set);
+}
+
+}//namespace http
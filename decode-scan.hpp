@@ -0,0 +1,31 @@
+#ifndef DECODE_SCAN_HPP
+#define DECODE_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+
+// an octet set given as up to eight inclusive ranges, written as
+// lo hi pairs: "09AZaz" holds the digits and the letters.  the pairs
+// feed the SIMD scanners, the table the scalar one.
+struct scan_set_type {
+    char range[16];
+    int size;
+    uint8_t member[256];
+    explicit scan_set_type (char const* pairs);
+    bool has (uint32_t const octet) const { return member[octet & 0xff] != 0; }
+};
+
+// the length of the longest prefix of p[0..n) whose octets all belong
+// to the set.  scan_span picks the widest implementation the CPU runs.
+std::size_t scan_span (char const* p, std::size_t const n, scan_set_type const& set);
+std::size_t scan_span_scalar (char const* p, std::size_t const n, scan_set_type const& set);
+std::size_t scan_span_sse42 (char const* p, std::size_t const n, scan_set_type const& set);
+std::size_t scan_span_avx2 (char const* p, std::size_t const n, scan_set_type const& set);
+bool scan_has_sse42 ();
+bool scan_has_avx2 ();
+
+}//namespace http
+
+#endif
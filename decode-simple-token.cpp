@@ -3,7 +3,7 @@
 #include <cctype>
 #include <algorithm>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
 
 namespace http {
 
@@ -33,28 +33,50 @@ namespace http {
 //
 //      S5: MATCH
 
+enum {MATCH, TCH, COMMA, WS, END, NCLASS};
+
+constexpr dfa_class_type CLASSES[] = {
+    {"!!#'*+-.09AZ^z||~~", TCH}, {",,", COMMA}, {"\t\t  ", WS},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {1, dfa_mask (TCH), 0x12}, {1, dfa_mask (COMMA, WS), 0x01},
+    {2, dfa_mask (TCH), 0x12}, {2, dfa_mask (COMMA), 0x24}, {2, dfa_mask (WS), 0x23},
+    {2, dfa_mask (END), 0x25},
+    {3, dfa_mask (COMMA), 0x04}, {3, dfa_mask (WS), 0x03}, {3, dfa_mask (END), 0x05},
+    {4, dfa_mask (TCH), 0x12}, {4, dfa_mask (COMMA, WS), 0x04}, {4, dfa_mask (END), 0x05},
+    {5, dfa_mask (MATCH), 1},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<6, NCLASS> SHIFT = dfa_shift_table<6, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int8_t HAND_SHIFT[6][5] = {
+//      tchar [,]   [\t ] $
+    {0, 0x00, 0x00, 0x00, 0x00},
+    {0, 0x12, 0x01, 0x01, 0x00}, // S1
+    {0, 0x12, 0x24, 0x23, 0x25}, // S2
+    {0, 0x00, 0x04, 0x03, 0x05}, // S3
+    {0, 0x12, 0x04, 0x04, 0x05}, // S4
+    {1, 0x00, 0x00, 0x00, 0x00}, // S5
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r
+    0x00000000, 0x03000000, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x31011111, 0x00112110, 0x11111111, 0x11000000,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x01111111, 0x11111111, 0x11111111, 0x11100011,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x11111111, 0x11111111, 0x11111111, 0x11101010,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "simple token classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "simple token transitions");
+
 bool
 decode (std::vector<simple_token_type>& fields, std::string const& src, int const lowerlimit)
 {
-    static const int8_t SHIFT[6][5] = {
-    //      tchar [,]   [\t ] $
-        {0, 0x00, 0x00, 0x00, 0x00},
-        {0, 0x12, 0x01, 0x01, 0x00}, // S1
-        {0, 0x12, 0x24, 0x23, 0x25}, // S2
-        {0, 0x00, 0x04, 0x03, 0x05}, // S3
-        {0, 0x12, 0x04, 0x04, 0x05}, // S4
-        {1, 0x00, 0x00, 0x00, 0x00}, // S5
-    };
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r
-        0x00000000, 0x03000000, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x31011111, 0x00112110, 0x11111111, 0x11000000,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x01111111, 0x11111111, 0x11111111, 0x11100011,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x11111111, 0x11111111, 0x11111111, 0x11101010,
-    };
     std::vector<simple_token_type> list;
     std::string::const_iterator s = src.cbegin ();
     std::string::const_iterator const e = src.cend ();
@@ -63,7 +85,7 @@ decode (std::vector<simple_token_type>& fields, std::string const& src, int cons
     int next_state = 1 == lowerlimit ? 1 : 4;
     for (; s <= e; ++s) {
         uint32_t octet = s == e ? '\0' : static_cast<uint8_t> (*s);
-        int cls = s == e ? 4 : lookup_cls (CCLASS, octet);
+        int cls = s == e ? END : CCLASS (octet);
         int prev_state = next_state;
         next_state = ! cls ? 0 : SHIFT[prev_state][cls] & 0x0f;
         if (! next_state)
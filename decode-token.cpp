@@ -3,7 +3,7 @@
 #include <algorithm>
 #include <cctype>
 #include "http.hpp"
-#include "decode-lookup-cls.hpp"
+#include "decode-dfa.hpp"
 
 namespace http {
 
@@ -72,36 +72,73 @@ namespace http {
 //
 //      Sd: MATCH
 
+// QDTEXT is the set of classes the grammar calls qdtext.
+enum {MATCH, QDT, TCH, WS, SEMI, EQUAL, COMMA, BSLASH, DQUOTE, END, NCLASS};
+
+constexpr uint32_t QDTEXT = dfa_mask (QDT, TCH, WS, SEMI, EQUAL, COMMA);
+
+constexpr dfa_class_type CLASSES[] = {
+    {"\t\t  ", WS}, {";;", SEMI}, {"==", EQUAL}, {",,", COMMA}, {"\\\\", BSLASH},
+    {"\"\"", DQUOTE}, {"!!#'*+-.09AZ^z||~~", TCH}, {"!~", QDT},
+};
+
+constexpr dfa_edge_type EDGES[] = {
+    {0x1, dfa_mask (TCH), 0x12}, {0x1, dfa_mask (WS, COMMA), 0x01},
+    {0x2, dfa_mask (TCH), 0x12}, {0x2, dfa_mask (WS), 0x03}, {0x2, dfa_mask (SEMI), 0x04},
+    {0x2, dfa_mask (COMMA), 0x5c}, {0x2, dfa_mask (END), 0x5d},
+    {0x3, dfa_mask (WS), 0x03}, {0x3, dfa_mask (SEMI), 0x04},
+    {0x3, dfa_mask (COMMA), 0x5c}, {0x3, dfa_mask (END), 0x5d},
+    {0x4, dfa_mask (TCH), 0x25}, {0x4, dfa_mask (WS), 0x04},
+    {0x5, dfa_mask (TCH), 0x25}, {0x5, dfa_mask (WS), 0x06}, {0x5, dfa_mask (EQUAL), 0x07},
+    {0x6, dfa_mask (WS), 0x06}, {0x6, dfa_mask (EQUAL), 0x07},
+    {0x7, dfa_mask (TCH), 0x38}, {0x7, dfa_mask (WS), 0x07}, {0x7, dfa_mask (DQUOTE), 0x0a},
+    {0x8, dfa_mask (TCH), 0x38}, {0x8, dfa_mask (WS), 0x4b}, {0x8, dfa_mask (SEMI), 0x44},
+    {0x8, dfa_mask (COMMA), 0x6c}, {0x8, dfa_mask (END), 0x6d},
+    {0x9, QDTEXT | dfa_mask (BSLASH, DQUOTE), 0x3a},
+    {0xa, QDTEXT, 0x3a}, {0xa, dfa_mask (BSLASH), 0x09}, {0xa, dfa_mask (DQUOTE), 0x4b},
+    {0xb, dfa_mask (WS), 0x0b}, {0xb, dfa_mask (SEMI), 0x04},
+    {0xb, dfa_mask (COMMA), 0x5c}, {0xb, dfa_mask (END), 0x5d},
+    {0xc, dfa_mask (TCH), 0x12}, {0xc, dfa_mask (WS, COMMA), 0x0c}, {0xc, dfa_mask (END), 0x0d},
+    {0xd, dfa_mask (MATCH), 1},
+};
+
+constexpr dfa_octet_table_type CCLASS = dfa_octet_table (CLASSES);
+constexpr dfa_shift_table_type<14, NCLASS> SHIFT = dfa_shift_table<14, NCLASS> (EDGES);
+
+// the hand-compiled tables the generated ones took over from.
+constexpr int HAND_SHIFT[14][10] = {
+//     qdtext tchar [\t ] [;]   [=]   [,]   [\\]  ["]   $
+    {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0, 0x00, 0x12, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00}, // S1
+    {0, 0x00, 0x12, 0x03, 0x04, 0x00, 0x5c, 0x00, 0x00, 0x5d}, // S2
+    {0, 0x00, 0x00, 0x03, 0x04, 0x00, 0x5c, 0x00, 0x00, 0x5d}, // S3
+    {0, 0x00, 0x25, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // S4
+    {0, 0x00, 0x25, 0x06, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00}, // S5
+    {0, 0x00, 0x00, 0x06, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00}, // S6
+    {0, 0x00, 0x38, 0x07, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x00}, // S7
+    {0, 0x00, 0x38, 0x4b, 0x44, 0x00, 0x6c, 0x00, 0x00, 0x6d}, // S8
+    {0, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x00}, // S9
+    {0, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x09, 0x4b, 0x00}, // Sa
+    {0, 0x00, 0x00, 0x0b, 0x04, 0x00, 0x5c, 0x00, 0x00, 0x5d}, // Sb
+    {0, 0x00, 0x12, 0x0c, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x0d}, // Sc
+    {1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // Sd
+};
+constexpr uint32_t HAND_CCLASS[16] = {
+//                 tn  r                          
+    0x00000000, 0x03000000, 0x00000000, 0x00000000,
+//     !"#$%&'    ()*+,-./    01234567    89:;<=>?
+    0x32822222, 0x11226221, 0x22222222, 0x22141511,
+//    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
+    0x12222222, 0x22222222, 0x22222222, 0x22217122,
+//    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
+    0x22222222, 0x22222222, 0x22222222, 0x22212120,
+};
+static_assert (dfa_same_class (CCLASS, HAND_CCLASS), "token classes");
+static_assert (dfa_same_shift (SHIFT, HAND_SHIFT), "token transitions");
+
 bool
 decode (std::vector<token_type>& fields, std::string const& src, int const lowerlimit)
 {
-    static const int SHIFT[14][10] = {
-    //     qdtext tchar [\t ] [;]   [=]   [,]   [\\]  ["]   $
-        {0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        {0, 0x00, 0x12, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00}, // S1
-        {0, 0x00, 0x12, 0x03, 0x04, 0x00, 0x5c, 0x00, 0x00, 0x5d}, // S2
-        {0, 0x00, 0x00, 0x03, 0x04, 0x00, 0x5c, 0x00, 0x00, 0x5d}, // S3
-        {0, 0x00, 0x25, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // S4
-        {0, 0x00, 0x25, 0x06, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00}, // S5
-        {0, 0x00, 0x00, 0x06, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00}, // S6
-        {0, 0x00, 0x38, 0x07, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x00}, // S7
-        {0, 0x00, 0x38, 0x4b, 0x44, 0x00, 0x6c, 0x00, 0x00, 0x6d}, // S8
-        {0, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x00}, // S9
-        {0, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x3a, 0x09, 0x4b, 0x00}, // Sa
-        {0, 0x00, 0x00, 0x0b, 0x04, 0x00, 0x5c, 0x00, 0x00, 0x5d}, // Sb
-        {0, 0x00, 0x12, 0x0c, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x0d}, // Sc
-        {1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // Sd
-    };
-    static const uint32_t CCLASS[16] = {
-    //                 tn  r                          
-        0x00000000, 0x03000000, 0x00000000, 0x00000000,
-    //     !"#$%&'    ()*+,-./    01234567    89:;<=>?
-        0x32822222, 0x11226221, 0x22222222, 0x22141511,
-    //    @ABCDEFG    HIJKLMNO    PQRSTUVW    XYZ[\]^_
-        0x12222222, 0x22222222, 0x22222222, 0x22217122,
-    //    `abcdefg    hijklmno    pqrstuvw    xyz{|}~ 
-        0x22222222, 0x22222222, 0x22222222, 0x22212120,
-    };
     std::vector<token_type> list;
     token_type item;
     std::string::const_iterator s = src.cbegin ();
@@ -112,7 +149,7 @@ decode (std::vector<token_type>& fields, std::string const& src, int const lower
     int next_state = 1 == lowerlimit ? 1 : 12;
     for (; s <= e; ++s) {
         uint32_t octet = s == e ? '\0' : static_cast<uint8_t> (*s);
-        int cls = s == e ? 9 : lookup_cls (CCLASS, octet);
+        int cls = s == e ? END : CCLASS (octet);
         int prev_state = next_state;
         next_state = 0 == cls ? 0 : SHIFT[prev_state][cls] & 0x0f;
         if (! next_state)
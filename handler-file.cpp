@@ -1,10 +1,12 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include <cctype>
 #include <cerrno>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "server.hpp"
@@ -40,7 +42,7 @@ handler_file_type::get (http::connection_type& r)
                       + "-" + std::to_string (st.st_mtime)
                       + "-" + std::to_string (st.st_size) + "\"";
     condition_type precond ({false, etag}, st.st_mtime);
-    int code = precond.check (r.request.method, r.request.header);
+    int code = precond.check (r.request.method_id, r.request.header);
     if (400 == code)
         return bad_request (r);
     if (412 == code)
@@ -52,7 +54,7 @@ handler_file_type::get (http::connection_type& r)
     r.response.header["last-modified"] = time_to_string (httpdate, st.st_mtime);
     if (304 == code)
         return not_modified (r);
-    if (r.request.method == "HEAD")
+    if (METHOD_HEAD == r.request.method_id)
         return true;
     int file_fd = open (path.c_str (), O_RDONLY);
     if (file_fd < 0)
@@ -61,6 +63,218 @@ handler_file_type::get (http::connection_type& r)
     return true;
 }
 
+// PUT writes the body into a hidden file next to the target, named
+// after the handler so that concurrent uploads never share it, and
+// renames it over the target once the whole body has arrived.  the
+// hidden name cannot be fetched since splitpath rejects a leading dot.
+void
+handler_file_type::body_begin (http::connection_type& r)
+{
+    config_type const& cfg = config_type::getinstance ();
+    if (METHOD_PUT != r.request.method_id || cfg.upload_dir.empty ())
+        return handler_type::body_begin (r);
+    location_type loc;
+    upload_error = 0;
+    upload_size = 0;
+    upload_synced = 0;
+    if (! loc.splitpath (r.request.uri))
+        return upload_fail (ENOENT);
+    upload_path = cfg.upload_dir + loc.catpath ();
+    std::string const parent = upload_path.substr (0, upload_path.size () - loc.name.size ());
+    upload_temp = parent + "." + loc.name + ".upload-" + std::to_string (getpid ())
+        + "-" + std::to_string (reinterpret_cast<uintptr_t> (this));
+    upload_fd = open (upload_temp.c_str (), O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+    if (upload_fd < 0) {
+        upload_temp.clear ();
+        upload_fail (errno);
+    }
+}
+
+std::size_t
+handler_file_type::body (http::connection_type& r, char const* p, std::size_t const n)
+{
+    if (METHOD_PUT != r.request.method_id)
+        return handler_type::body (r, p, n);
+    std::size_t pos = 0;
+    while (upload_fd >= 0 && pos < n) {
+        ssize_t const k = write (upload_fd, p + pos, n - pos);
+        if (k < 0 && EINTR == errno)
+            continue;
+        if (k <= 0) {
+            upload_fail (k < 0 ? errno : ENOSPC);
+            break;
+        }
+        pos += k;
+        upload_advance (k);
+    }
+    return n;
+}
+
+bool
+handler_file_type::splice_body (http::connection_type& r)
+{
+    return upload_fd >= 0;
+}
+
+// the octets move from the pipe into the page cache without a copy
+// through user space.  after a failure the rest is drained and dropped.
+void
+handler_file_type::body_pipe (http::connection_type& r, int const fd, std::size_t const n)
+{
+    std::size_t left = n;
+    while (upload_fd >= 0 && left > 0) {
+        ssize_t const k = splice (fd, nullptr, upload_fd, nullptr, left, SPLICE_F_MOVE);
+        if (k < 0 && EINTR == errno)
+            continue;
+        if (k <= 0) {
+            upload_fail (k < 0 ? errno : ENOSPC);
+            break;
+        }
+        left -= k;
+        upload_advance (k);
+    }
+    char buf[BUFFER_SIZE];
+    while (left > 0) {
+        ssize_t const k = read (fd, buf, std::min<std::size_t> (left, sizeof buf));
+        if (k <= 0)
+            break;
+        left -= k;
+    }
+}
+
+// with --upload-sync, writeback of every full batch starts while the
+// body is still arriving, so that the fdatasync before the rename
+// only waits for the tail.
+void
+handler_file_type::upload_advance (std::size_t const n)
+{
+    std::size_t const batch = config_type::getinstance ().upload_sync;
+    upload_size += n;
+    if (batch > 0 && upload_size - upload_synced >= off_t (batch)) {
+        sync_file_range (upload_fd, upload_synced, upload_size - upload_synced,
+            SYNC_FILE_RANGE_WRITE);
+        upload_synced = upload_size;
+    }
+}
+
+void
+handler_file_type::upload_fail (int const e)
+{
+    if (0 == upload_error)
+        upload_error = e;
+    if (upload_fd >= 0) {
+        close (upload_fd);
+        upload_fd = -1;
+    }
+}
+
+// the target, when it exists, must be a regular file whose validators
+// satisfy the request's conditional headers.
+bool
+handler_file_type::upload_check (http::connection_type& r)
+{
+    struct stat st;
+    if (stat (upload_path.c_str (), &st) < 0)
+        return true;
+    if (! S_ISREG (st.st_mode)) {
+        method_not_allowed (r);
+        return false;
+    }
+    std::string etag = "\"" + std::to_string (st.st_ino)
+                      + "-" + std::to_string (st.st_mtime)
+                      + "-" + std::to_string (st.st_size) + "\"";
+    condition_type precond ({false, etag}, st.st_mtime);
+    int code = precond.check (r.request.method_id, r.request.header);
+    if (400 == code)
+        bad_request (r);
+    else if (412 == code)
+        precondition_failed (r);
+    return 400 != code && 412 != code;
+}
+
+// everything put would refuse after the body is known before it: a
+// file handler serves no POST, and no PUT without --upload-dir, and a
+// PUT fails on its target path or on the state of an existing file.
+bool
+handler_file_type::accept_body (http::connection_type& r)
+{
+    if (METHOD_PUT != r.request.method_id
+            || config_type::getinstance ().upload_dir.empty ()) {
+        method_not_allowed (r);
+        return false;
+    }
+    if (0 != upload_error) {
+        put (r);
+        return false;
+    }
+    return upload_check (r);
+}
+
+// an upload goes to a file, so its length is bounded only by the
+// decoder.
+ssize_t
+handler_file_type::max_body (http::connection_type& r)
+{
+    if (METHOD_PUT == r.request.method_id)
+        return std::numeric_limits<ssize_t>::max ();
+    return handler_type::max_body (r);
+}
+
+bool
+handler_file_type::put (http::connection_type& r)
+{
+    if (config_type::getinstance ().upload_dir.empty ())
+        return method_not_allowed (r);
+    if (0 == upload_error && upload_fd < 0)
+        return length_required (r);
+    if (0 != upload_error) {
+        int const e = upload_error;
+        release (r);
+        if (ENOENT == e || ENOTDIR == e)
+            return not_found (r);
+        if (EISDIR == e)
+            return method_not_allowed (r);
+        return internal_server_error (r);
+    }
+    struct stat st;
+    bool const exists = stat (upload_path.c_str (), &st) == 0;
+    if (! upload_check (r)) {
+        release (r);
+        return true;
+    }
+    bool const sync = config_type::getinstance ().upload_sync > 0;
+    if ((sync && fdatasync (upload_fd) < 0)
+            || rename (upload_temp.c_str (), upload_path.c_str ()) < 0) {
+        release (r);
+        return internal_server_error (r);
+    }
+    upload_temp.clear ();
+    if (sync) {
+        std::string const parent = upload_path.substr (0, upload_path.rfind ('/') + 1);
+        int const dir_fd = open (parent.c_str (), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd >= 0) {
+            fsync (dir_fd);
+            close (dir_fd);
+        }
+    }
+    release (r);
+    return exists ? no_content (r) : created (r);
+}
+
+void
+handler_file_type::release (http::connection_type& r)
+{
+    if (upload_fd >= 0) {
+        close (upload_fd);
+        upload_fd = -1;
+    }
+    if (! upload_temp.empty ()) {
+        unlink (upload_temp.c_str ());
+        upload_temp.clear ();
+    }
+    upload_error = 0;
+}
+
 std::string
 handler_file_type::mime_type (std::string const& ext) const
 {
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/timerfd.h>
 #include "server.hpp"
 
 namespace http {
@@ -49,4 +53,48 @@ handler_test_type::post (http::connection_type& r)
     return true;
 }
 
+void
+handler_test_type::body_begin (http::connection_type& r)
+{
+    handler_type::body_begin (r);
+    credit = config_type::getinstance ().test_throttle;
+}
+
+// each expiry of the tick grants another span of octets.
+std::size_t
+handler_test_type::body (http::connection_type& r, char const* p, std::size_t const n)
+{
+    std::size_t const span = config_type::getinstance ().test_throttle;
+    if (0 == span)
+        return handler_type::body (r, p, n);
+    uint64_t ticks = 0;
+    if (tick_fd >= 0 && read (tick_fd, &ticks, sizeof ticks) == sizeof ticks)
+        credit += ticks * span;
+    std::size_t const m = std::min (n, credit);
+    credit -= m;
+    return handler_type::body (r, p, m);
+}
+
+int
+handler_test_type::body_wait (http::connection_type& r)
+{
+    if (tick_fd < 0)
+        tick_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (tick_fd < 0)
+        return -1;
+    struct itimerspec const t = {{0, 0}, {0, TICK * 1000000L}};
+    if (timerfd_settime (tick_fd, 0, &t, nullptr) < 0)
+        return -1;
+    return tick_fd;
+}
+
+void
+handler_test_type::release (http::connection_type& r)
+{
+    if (tick_fd >= 0)
+        close (tick_fd);
+    tick_fd = -1;
+    credit = 0;
+}
+
 }//namespace http
@@ -1,6 +1,8 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <algorithm>
+#include <unistd.h>
 #include "server.hpp"
 
 namespace http {
@@ -8,15 +10,17 @@ namespace http {
 bool
 handler_type::process (http::connection_type& r)
 {
-    if (r.request.method == "GET")
+    switch (r.request.method_id) {
+    case METHOD_GET:
+    case METHOD_HEAD:
         return get (r);
-    else if (r.request.method == "HEAD")
-        return get (r);
-    else if (r.request.method == "POST")
+    case METHOD_POST:
         return post (r);
-    else if (r.request.method == "PUT")
+    case METHOD_PUT:
         return put (r);
-    return method_not_allowed (r);
+    default:
+        return method_not_allowed (r);
+    }
 }
 
 bool
@@ -37,6 +41,82 @@ handler_type::put (http::connection_type& r)
     return method_not_allowed (r);
 }
 
+// after body_begin and before the body is read, the connection asks
+// whether the request will be served at all.  a handler that refuses
+// prepares the final response and answers false; the body is then
+// never read.
+bool
+handler_type::accept_body (http::connection_type& r)
+{
+    return true;
+}
+
+// the most octets of body the handler takes: a longer Content-Length is
+// refused with 413 before the body is read, and a chunked body as soon
+// as it grows past.  the default collects the body in memory, so it is
+// held to --max-body.
+ssize_t
+handler_type::max_body (http::connection_type& r)
+{
+    return config_type::getinstance ().max_body;
+}
+
+// the request body reaches the handler in spans as it is decoded,
+// before process runs.  body returns how many octets it took; taking
+// fewer leaves the rest in the input buffer, and the connection stops
+// reading the socket until the descriptor named by body_wait becomes
+// readable.  the default collects the whole body into request.body.
+void
+handler_type::body_begin (http::connection_type& r)
+{
+    r.request.body.clear ();
+}
+
+std::size_t
+handler_type::body (http::connection_type& r, char const* p, std::size_t const n)
+{
+    r.request.body.append (p, n);
+    return n;
+}
+
+// a handler that answers true gets the rest of a Content-Length body
+// through body_pipe: n octets wait in the pipe fd, and body_pipe must
+// move all of them out before it returns.
+bool
+handler_type::splice_body (http::connection_type& r)
+{
+    return false;
+}
+
+void
+handler_type::body_pipe (http::connection_type& r, int const fd, std::size_t const n)
+{
+    char buf[BUFFER_SIZE];
+    std::size_t left = n;
+    while (left > 0) {
+        ssize_t const k = read (fd, buf, std::min<std::size_t> (left, sizeof buf));
+        if (k <= 0)
+            break;
+        r.request.body.append (buf, k);
+        left -= k;
+    }
+}
+
+// a handler that takes fewer octets than offered names a descriptor
+// that turns readable once it can take more.  the connection polls it
+// in place of the socket; -1 fails the request with 500.
+int
+handler_type::body_wait (http::connection_type& r)
+{
+    return -1;
+}
+
+// called once the response has been written or the connection closes.
+void
+handler_type::release (http::connection_type& r)
+{
+}
+
 bool
 handler_type::not_modified (http::connection_type& r)
 {
@@ -46,6 +126,23 @@ handler_type::not_modified (http::connection_type& r)
     return true;
 }
 
+bool
+handler_type::created (http::connection_type& r)
+{
+    r.response.code = 201;
+    r.response.body.clear ();
+    r.response.header["content-length"] = "0";
+    return true;
+}
+
+bool
+handler_type::no_content (http::connection_type& r)
+{
+    r.response.code = 204;
+    r.response.body.clear ();
+    return true;
+}
+
 bool
 handler_type::bad_request (http::connection_type& r)
 {
@@ -114,7 +211,7 @@ bool
 handler_type::precondition_failed (http::connection_type& r)
 {
     html_builder_type html;
-    error_start (r, html, 411);
+    error_start (r, html, 412);
     html <<
         "<p>The precondition on the request "
         "for the URL " << r.request.uri <<
@@ -151,6 +248,32 @@ handler_type::unsupported_media_type (http::connection_type& r)
     return true;
 }
 
+bool
+handler_type::expectation_failed (http::connection_type& r)
+{
+    html_builder_type html;
+    error_start (r, html, 417);
+    html <<
+        "<p>The expectation given in the Expect request\n"
+        "header could not be met by this server.</p>\n";
+    error_end (r, html);
+    r.response.header["connection"] = "close";
+    return true;
+}
+
+bool
+handler_type::internal_server_error (http::connection_type& r)
+{
+    html_builder_type html;
+    error_start (r, html, 500);
+    html <<
+        "<p>The server encountered an internal error and\n"
+        "was unable to complete your request.</p>\n";
+    error_end (r, html);
+    r.response.header["connection"] = "close";
+    return true;
+}
+
 void
 handler_type::error_start (http::connection_type& r, html_builder_type& html, int code)
 {
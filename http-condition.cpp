@@ -6,21 +6,20 @@
 namespace http {
 
 int
-condition_type::check (std::string const& method,
-    std::map<std::string, std::string>& header)
+condition_type::check (method_type const method, header_map_type const& header)
 {
-    bool isget = (method == "GET" || method == "HEAD");
+    bool isget = (METHOD_GET == method || METHOD_HEAD == method);
     int r = OK;
-    if (header.count ("if-match") > 0)
-        r = if_match (header.at ("if-match"));
-    else if (header.count ("if-unmodified-since") > 0)
-        r = if_unmodified_since (header.at ("if-unmodified-since"));
+    if (header.count (HEADER_IF_MATCH) > 0)
+        r = if_match (header.at (HEADER_IF_MATCH));
+    else if (header.count (HEADER_IF_UNMODIFIED_SINCE) > 0)
+        r = if_unmodified_since (header.at (HEADER_IF_UNMODIFIED_SINCE));
     if (OK != r)
         return 412;
-    if (header.count ("if-none-match") > 0)
-        r = if_none_match (header.at ("if-none-match"));
-    else if (isget && header.count ("if-modified-since") > 0)
-        r = if_modified_since (header.at ("if-modified-since"));
+    if (header.count (HEADER_IF_NONE_MATCH) > 0)
+        r = if_none_match (header.at (HEADER_IF_NONE_MATCH));
+    else if (isget && header.count (HEADER_IF_MODIFIED_SINCE) > 0)
+        r = if_modified_since (header.at (HEADER_IF_MODIFIED_SINCE));
     if (OK != r)
         return isget ? 304 : 412;
     return 200;
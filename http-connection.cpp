@@ -2,14 +2,18 @@
 #include <vector>
 #include <algorithm>
 #include <cctype>
+#include <climits>
 #include <ctime>
 #include <cerrno>
+#include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <linux/errqueue.h>
 #include "server.hpp"
 
 namespace http {
@@ -17,18 +21,15 @@ namespace http {
 int
 connection_type::on_accept (tcpserver_type& loop)
 {
-    logger_type& log = logger_type::getinstance ();
     std::string addr;
     int sock = loop.accept_client (addr);
     if (sock < 0)
         return FREE;
-    else if (loop.fd_set_nonblock (sock) < 0)
-        log.put_error ("fd_set_nonblock (conn_sock)");
     else if ((handle_id = loop.mplex.add (READ_EVENT|EDGE_EVENT, sock, id)) < 0)
         ;
     else {
         remote_addr = addr;
-        std::time_t uptime = loop.looptime () + loop.timeout ();
+        int64_t uptime = loop.looptime () + loop.timeout ();
         loop.mplex.mod_timer (uptime, handle_id);
         clear ();
         decoder_request_line.set_limit_nbyte (LIMIT_REQUEST_FIELD_SIZE);
@@ -50,8 +51,7 @@ connection_type::on_read (tcpserver_type& loop)
     logger_type& log = logger_type::getinstance ();
     ssize_t n = iotransfer (loop);
     if (n > 0) {
-        std::time_t uptime = loop.looptime () + loop.timeout ();
-        loop.mplex.mod_timer (uptime, handle_id);
+        rearm_timer (loop);
         if (iowait_mask & WRITE_EVENT) {
             if (loop.mplex.mod (WRITE_EVENT|EDGE_EVENT, handle_id) < 0)
                 return loop.remove_handler (id);
@@ -75,10 +75,9 @@ connection_type::on_write (tcpserver_type& loop)
     logger_type& log = logger_type::getinstance ();
     ssize_t n = iotransfer (loop);
     if (n > 0) {
-        std::time_t uptime = loop.looptime () + loop.timeout ();
-        loop.mplex.mod_timer (uptime, handle_id);
-        if (iowait_mask & READ_EVENT) {
-            if (loop.mplex.mod (READ_EVENT|EDGE_EVENT, handle_id) < 0)
+        rearm_timer (loop);
+        if (iowait_mask & (READ_EVENT|ERROR_EVENT)) {
+            if (loop.mplex.mod (iowait_mask|EDGE_EVENT, handle_id) < 0)
                 return loop.remove_handler (id);
         }
         return WAIT;
@@ -94,16 +93,69 @@ connection_type::on_write (tcpserver_type& loop)
     return loop.remove_handler (id);
 }
 
+// the error queue of the socket reports MSG_ZEROCOPY completions.
+int
+connection_type::on_error (tcpserver_type& loop)
+{
+    logger_type& log = logger_type::getinstance ();
+    ssize_t n = iotransfer (loop);
+    if (n > 0) {
+        rearm_timer (loop);
+        if (iowait_mask & (READ_EVENT|WRITE_EVENT)) {
+            if (loop.mplex.mod (iowait_mask|EDGE_EVENT, handle_id) < 0)
+                return loop.remove_handler (id);
+        }
+        return WAIT;
+    }
+    else if (n < 0 && EINTR == errno)
+        return WAIT;
+    else if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+        loop.mplex.drop (ERROR_EVENT, handle_id);
+        return WAIT;
+    }
+    else if (n < 0)
+        log.put_error ("recvmsg MSG_ERRQUEUE");
+    return loop.remove_handler (id);
+}
+
 int
 connection_type::on_timer (tcpserver_type& loop)
 {
     return loop.remove_handler (id);
 }
 
+// the request line and header fields must arrive within header_timeout
+// counted from their first octet, while each read or write in other
+// states, and the idle wait for a request, extends the deadline by
+// timeout.
+void
+connection_type::rearm_timer (tcpserver_type& loop)
+{
+    if (! rdstarted
+            || (kont != &connection_type::kont_request_line_read
+                && kont != &connection_type::kont_request_header_read)) {
+        int64_t uptime = loop.looptime () + loop.timeout ();
+        loop.mplex.mod_timer (uptime, handle_id);
+    }
+}
+
+// a connection closed with zerocopy sends outstanding releases the
+// body while the kernel may still retransmit from its pages.  only
+// timeouts and errors take this path, and their response is lost anyway.
 void
 connection_type::on_close (tcpserver_type& loop)
 {
     kont = nullptr;
+    if (rdwait_handle >= 0) {
+        loop.mplex.del (rdwait_handle);
+        rdwait_handle = -1;
+    }
+    release_handler ();
+    if (rdpipe[0] >= 0) {
+        close (rdpipe[0]);
+        close (rdpipe[1]);
+        rdpipe[0] = rdpipe[1] = -1;
+    }
     int fd = loop.mplex.fd (handle_id);
     loop.mplex.del (handle_id);
     if (fd >= 0)
@@ -114,8 +166,13 @@ void
 connection_type::clear ()
 {
     keepalive_requests = 0;
-    rdpos = 0;
-    rdsize = 0;
+    rdstarted = false;
+    rdbuf.clear ();
+    rdbuf.shrink ();
+    wrbatch.clear ();
+    zerocopy = 0;
+    zc_sent = 0;
+    zc_done = 0;
     request.clear ();
     response.clear ();
     decoder_request_line.clear ();
@@ -145,15 +202,6 @@ to_xdigits (ssize_t const n)
     return t;
 }
 
-static inline void
-setsockopt_cork (int const sock, bool const flag)
-{
-    int const e = errno;
-    int state = flag ? 1 : 0;
-    setsockopt (sock, IPPROTO_TCP, TCP_CORK, &state, sizeof (state));
-    errno = e;
-}
-
 void
 connection_type::ioready ()
 {
@@ -180,12 +228,6 @@ connection_type::iostop ()
     kont_ready = false;
 }
 
-static inline int
-ord (char c)
-{
-    return static_cast<uint8_t> (c);
-}
-
 ssize_t
 connection_type::iotransfer (tcpserver_type& loop)
 {
@@ -198,9 +240,12 @@ connection_type::iotransfer (tcpserver_type& loop)
 void
 connection_type::kont_request_line (tcpserver_type& loop)
 {
-    while (rdpos < rdsize)
-        if (! decoder_request_line.put (ord (rdbuf[rdpos++]), request))
-            break;
+    if (! rdstarted && ! rdbuf.empty ()) {
+        rdstarted = true;
+        int64_t uptime = loop.looptime () + loop.header_timeout ();
+        loop.mplex.mod_timer (uptime, handle_id);
+    }
+    rdbuf.consume (decoder_request_line.put (rdbuf.data (), rdbuf.size (), request));
     if (decoder_request_line.partial ())
         iocontinue (READ_EVENT, &connection_type::kont_request_line_read);
     else
@@ -210,9 +255,7 @@ connection_type::kont_request_line (tcpserver_type& loop)
 void
 connection_type::kont_request_header (tcpserver_type& loop)
 {
-    while (rdpos < rdsize)
-        if (! decoder_request_header.put (ord (rdbuf[rdpos++]), request))
-            break;
+    rdbuf.consume (decoder_request_header.put (rdbuf.data (), rdbuf.size (), request));
     if (decoder_request_header.partial ())
         iocontinue (READ_EVENT, &connection_type::kont_request_header_read);
     else
@@ -223,17 +266,24 @@ void
 connection_type::prepare_request_body ()
 {
     if (decoder_request_line.bad () || decoder_request_header.bad ()
-            || (request.http_version >= "HTTP/1.1"
-                && request.header.count ("host") == 0)) {
+            || (request.version >= HTTP_1_1
+                && request.header.count (HEADER_HOST) == 0)) {
         handler_type h;
         h.bad_request (*this);
         iocontinue (&connection_type::kont_response);
     }
     else {
         response.http_version = request.http_version;
-        if (request.header.count ("transfer-encoding") > 0)
+        response.version = request.version;
+        select_handler ();
+        if (! prepare_request_expect ()) {
+            handler_type h;
+            h.expectation_failed (*this);
+            iocontinue (&connection_type::kont_response);
+        }
+        else if (request.header.count (HEADER_TRANSFER_ENCODING) > 0)
             prepare_request_chunked ();
-        else if (request.header.count ("content-length") > 0)
+        else if (request.header.count (HEADER_CONTENT_LENGTH) > 0)
             prepare_request_length ();
         else
             iocontinue (&connection_type::kont_dispatch);
@@ -245,7 +295,7 @@ connection_type::prepare_request_chunked ()
 {
     handler_type h;
     std::vector<simple_token_type> te;
-    if (! decode (te, request.header["transfer-encoding"], 1)) {
+    if (! decode (te, request.header.at (HEADER_TRANSFER_ENCODING), 1)) {
         h.bad_request (*this);
         iocontinue (&connection_type::kont_response);
     }
@@ -254,17 +304,111 @@ connection_type::prepare_request_chunked ()
         iocontinue (&connection_type::kont_response);
     }
     else {
-        iocontinue (&connection_type::kont_request_chunked);
+        rdbody = 0;
+        rdspan.clear ();
+        handler ().body_begin (*this);
+        if (request_body_accepted (true))
+            iocontinue (&connection_type::kont_request_chunked);
     }
 }
 
+// Expect: 100-continue is the only expectation understood.  an
+// HTTP/1.0 client gets no interim response, so there it is ignored.
+bool
+connection_type::prepare_request_expect ()
+{
+    rdexpect = false;
+    if (request.header.count (HEADER_EXPECT) == 0)
+        return true;
+    std::vector<simple_token_type> expect;
+    if (! decode (expect, request.header.at (HEADER_EXPECT), 1)
+            || expect.size () != 1 || ! expect.back ().equal_token ("100-continue"))
+        return false;
+    rdexpect = request.version >= HTTP_1_1;
+    return true;
+}
+
+// the handler sees the route and headers before any of the body is
+// read.  a refusal, or a Content-Length past its max_body, is the final
+// response, and the unread body leaves the connection out of step, so
+// it closes.  a client that expects 100 Continue holds the body back
+// until then.  the interim response goes into the batch, which is
+// flushed before the first read of the body; none is sent when some
+// of the body has arrived already.
+bool
+connection_type::request_body_accepted (bool const pending)
+{
+    if (! handler ().accept_body (*this))
+        ;
+    else if (request.content_length > handler ().max_body (*this)) {
+        handler_type h;
+        h.request_entity_too_large (*this);
+    }
+    else {
+        if (rdexpect && pending && rdbuf.empty ())
+            wrbatch += "HTTP/1.1 100 Continue\r\n\r\n";
+        return true;
+    }
+    request_body_refuse ();
+    return false;
+}
+
+void
+connection_type::request_body_refuse ()
+{
+    response.header["connection"] = "close";
+    iocontinue (&connection_type::kont_response);
+}
+
+void
+connection_type::select_handler ()
+{
+    route = request.uri == "/test" ? ROUTE_TEST : ROUTE_FILE;
+}
+
+handler_type&
+connection_type::handler ()
+{
+    if (ROUTE_TEST == route)
+        return test_handler;
+    return file_handler;
+}
+
+void
+connection_type::release_handler ()
+{
+    if (ROUTE_NONE != route)
+        handler ().release (*this);
+    route = ROUTE_NONE;
+}
+
+// hands the decoded octets not yet taken to the handler.  false means
+// the handler is behind and the connection has to wait for it.
+bool
+connection_type::request_body_flush ()
+{
+    if (rdspan.empty ())
+        return true;
+    std::size_t const m = handler ().body (*this, rdspan.data (), rdspan.size ());
+    rdspan.erase (0, m);
+    rdbody += m;
+    return rdspan.empty ();
+}
+
 void
 connection_type::kont_request_chunked (tcpserver_type& loop)
 {
-    while (rdpos < rdsize)
-        if (! decoder_chunk.put (ord (rdbuf[rdpos++]), request.body))
-            break;
-    if (decoder_chunk.partial ())
+    if (! request_body_flush ())
+        return request_body_stall (loop, &connection_type::kont_request_chunked);
+    rdbuf.consume (decoder_chunk.put (rdbuf.data (), rdbuf.size (), rdspan));
+    if (rdbody + ssize_t (rdspan.size ()) > handler ().max_body (*this)) {
+        handler_type h;
+        h.request_entity_too_large (*this);
+        request_body_refuse ();
+    }
+    else if (! request_body_flush ())
+        request_body_stall (loop, &connection_type::kont_request_chunked);
+    else if (decoder_chunk.partial ())
         iocontinue (READ_EVENT, &connection_type::kont_request_chunked_read);
     else
         finalize_request_chunked ();
@@ -281,7 +425,7 @@ connection_type::finalize_request_chunked ()
     else {
         ssize_t const n = decoder_chunk.content_length;
         request.content_length = n;
-        request.header["content-length"] = std::to_string (n);
+        request.header.set ("content-length", std::to_string (n));
         iocontinue (&connection_type::kont_dispatch);
     }
 }
@@ -290,7 +434,7 @@ void
 connection_type::prepare_request_length ()
 {
     content_length_type canonlength;
-    decode (canonlength, request.header["content-length"]);
+    decode (canonlength, request.header.at (HEADER_CONTENT_LENGTH));
     if (400 == canonlength.status) {
         handler_type h;
         h.bad_request (*this);
@@ -301,30 +445,117 @@ connection_type::prepare_request_length ()
         h.request_entity_too_large (*this);
         iocontinue (&connection_type::kont_response);
     }
-    else if (request.method != "POST" && request.method != "PUT") {
+    else if (METHOD_POST != request.method_id && METHOD_PUT != request.method_id) {
         handler_type h;
         h.request_entity_too_large (*this);
         iocontinue (&connection_type::kont_response);
     }
     else {
-        request.header["content-length"] = std::to_string (canonlength.length);
+        request.header.set ("content-length", std::to_string (canonlength.length));
         request.content_length = canonlength.length;
-        iocontinue (&connection_type::kont_request_length);
+        rdbody = 0;
+        handler ().body_begin (*this);
+        if (request_body_accepted (request.content_length > 0))
+            iocontinue (&connection_type::kont_request_length);
     }
 }
 
 void
 connection_type::kont_request_length (tcpserver_type& loop)
 {
-    ssize_t n = std::min (rdsize - rdpos, request.content_length);
-    request.body.append (rdbuf, rdpos, n);
-    rdpos += n;
-    if (request.body.size () < request.content_length)
+    std::size_t const n = std::min<std::size_t> (rdbuf.size (),
+        request.content_length - rdbody);
+    std::size_t const m = n > 0 ? handler ().body (*this, rdbuf.data (), n) : 0;
+    rdbuf.consume (m);
+    rdbody += m;
+    if (rdbody == request.content_length)
+        iocontinue (&connection_type::kont_dispatch);
+    else if (m < n)
+        request_body_stall (loop, &connection_type::kont_request_length);
+    else if (handler ().splice_body (*this) && prepare_request_pipe ())
+        iocontinue (READ_EVENT, &connection_type::kont_request_splice);
+    else
         iocontinue (READ_EVENT, &connection_type::kont_request_length_read);
+}
+
+// once the input buffer is empty, a handler that asks for it gets the
+// rest of a Content-Length body through a pipe: splice moves the
+// octets from the socket into the pipe and the handler moves them on,
+// so they never pass through user space.
+bool
+connection_type::prepare_request_pipe ()
+{
+    if (rdpipe[0] < 0) {
+        if (pipe2 (rdpipe, O_NONBLOCK|O_CLOEXEC) < 0) {
+            rdpipe[0] = rdpipe[1] = -1;
+            return false;
+        }
+        fcntl (rdpipe[1], F_SETPIPE_SZ, PIPE_SIZE);
+        int const size = fcntl (rdpipe[1], F_GETPIPE_SZ);
+        rdpipe_size = size > 0 ? size : BUFFER_SIZE;
+    }
+    return true;
+}
+
+void
+connection_type::kont_request_splice (tcpserver_type& loop)
+{
+    if (! wrbatch.empty ()) {
+        rdkont = kont;
+        return wrbatch_flush (&connection_type::kont_response_flushed);
+    }
+    int sock = loop.mplex.fd (handle_id);
+    std::size_t const n = std::min<std::size_t> (request.content_length - rdbody, rdpipe_size);
+    ioresult = splice (sock, nullptr, rdpipe[1], nullptr, n, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    if (ioresult <= 0)
+        return iostop ();
+    handler ().body_pipe (*this, rdpipe[0], ioresult);
+    rdbody += ioresult;
+    if (rdbody < request.content_length)
+        iocontinue (READ_EVENT, &connection_type::kont_request_splice);
     else
         iocontinue (&connection_type::kont_dispatch);
 }
 
+// the handler took fewer octets than offered.  the socket is left
+// unread until the descriptor the handler names becomes readable; a
+// handler that names none can never catch up, so the request fails.
+void
+connection_type::request_body_stall (tcpserver_type& loop, kont_type const kontinuation)
+{
+    int const fd = handler ().body_wait (*this);
+    if (fd < 0 || (rdwait_handle = loop.mplex.add (READ_EVENT, fd, id)) < 0) {
+        rdwait_handle = -1;
+        handler_type h;
+        h.internal_server_error (*this);
+        response.header["connection"] = "close";
+        return iocontinue (&connection_type::kont_response);
+    }
+    loop.mplex.drop (READ_EVENT, handle_id);
+    rdkont = kontinuation;
+    iocontinue (READ_EVENT, &connection_type::kont_request_resume);
+}
+
+// both the socket and the handler's descriptor lead here, and only the
+// latter resumes.  its handle goes away, and the socket is woken once:
+// on its turn the stalled kontinuation offers the rest to the handler
+// and reads whatever arrived while the connection waited.  each call
+// touches only the handle being served, so the ready list stays intact.
+void
+connection_type::kont_request_resume (tcpserver_type& loop)
+{
+    if (loop.current_handle () != rdwait_handle) {
+        ioresult = -1;
+        errno = EAGAIN;
+        return iostop ();
+    }
+    loop.mplex.del (rdwait_handle);
+    rdwait_handle = -1;
+    loop.mplex.wake (READ_EVENT, handle_id);
+    ioresult = 1;
+    iocontinue (READ_EVENT, rdkont);
+}
+
 void
 connection_type::kont_request_line_read (tcpserver_type& loop)
 {
@@ -352,35 +583,70 @@ connection_type::kont_request_length_read (tcpserver_type& loop)
 void
 connection_type::read_with_kontinuation (tcpserver_type& loop, kont_type kontinuation)
 {
+    if (! wrbatch.empty ()) {
+        rdkont = kont;
+        return wrbatch_flush (&connection_type::kont_response_flushed);
+    }
     int sock = loop.mplex.fd (handle_id);
-    ioresult = read (sock, &rdbuf[0], BUFFER_SIZE);
+    ioresult = rdbuf.readv (sock);
     if (ioresult <= 0)
         return iostop ();
-    rdpos = 0;
-    rdsize = ioresult;
     iocontinue (kontinuation);
 }
 
 void
 connection_type::kont_dispatch (tcpserver_type& loop)
 {
-    if (request.uri == "/test") {
-        handler_test_type h;
-        h.process (*this);
-        iocontinue (&connection_type::kont_response);
+    handler ().process (*this);
+    iocontinue (&connection_type::kont_response);
+}
+
+void
+connection_type::kont_response (tcpserver_type& loop)
+{
+    prepare_response ();
+    wrqueue_clear ();
+    wrqueue_push (wrbatch.data (), wrbatch.size ());
+    wrqueue_push (wrbuf.data (), wrbuf.size ());
+    if (! response.has_body)
+        wrqueue_kontinue (false, &connection_type::kont_response_end);
+    else {
+        if (response.chunked)
+            start_chunks (loop);
+        prepare_response_body ();
     }
+    if (wrqueue_batch ())
+        iocontinue (&connection_type::kont_response_end);
     else {
-        handler_file_type h;
-        h.process (*this);
-        iocontinue (&connection_type::kont_response);
+        prepare_zerocopy (loop);
+        iocontinue (WRITE_EVENT, &connection_type::kont_response_gather);
     }
 }
 
+// in-memory bodies of --zerocopy octets or more go out with
+// MSG_ZEROCOPY.  SO_ZEROCOPY is turned on at the first such response;
+// when the socket refuses it, or the kernel reports that it copied
+// anyway, the connection keeps to plain sendmsg.
 void
-connection_type::kont_response (tcpserver_type& loop)
+connection_type::prepare_zerocopy (tcpserver_type& loop)
 {
-    prepare_response ();
-    iocontinue (WRITE_EVENT, &connection_type::kont_response_header);
+    wrzerocopy = false;
+    std::size_t const threshold = loop.zerocopy ();
+    if (0 == threshold || zerocopy < 0 || ! response.has_body
+            || wrkont != &connection_type::kont_response_end
+            || response.body.size () < threshold)
+        return;
+    if (0 == zerocopy) {
+        int const e = errno;
+        int const one = 1;
+        int const sock = loop.mplex.fd (handle_id);
+        zerocopy = setsockopt (sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) < 0 ? -1 : 1;
+        errno = e;
+    }
+    if (zerocopy > 0) {
+        wrzerocopy = true;
+        wrkont = &connection_type::kont_response_zerocopy;
+    }
 }
 
 void
@@ -389,7 +655,7 @@ connection_type::prepare_response ()
     decide_transfer_encoding ();
     response.has_body = true;
     int code = response.code;
-    if (request.method == "HEAD" || 304 == code)
+    if (METHOD_HEAD == request.method_id || 304 == code)
         response.has_body = false;
     else if ((100 <= code && code < 200) || 204 == code) {
         response.has_body = false;
@@ -400,186 +666,346 @@ connection_type::prepare_response ()
     }
     wrbuf = response.to_string ();
     wrpos = 0;
-    wrsize = wrbuf.size ();
+    wrsize = 0;
 }
 
 void
 connection_type::decide_transfer_encoding ()
 {
-    if (response.header.count ("transfer-encoding") > 0) {
-        std::vector<simple_token_type> te;
-        if (! decode (te, response.header["transfer-encoding"], 1)
-                || te.size () != 1 || ! te.back ().equal_token ("chunked"))
-            response.header.erase ("transfer-encoding");
+    auto& header = response.header;
+    auto te = header.find ("transfer-encoding");
+    if (te != header.end ()) {
+        std::vector<simple_token_type> tokens;
+        if (! decode (tokens, te->second, 1)
+                || tokens.size () != 1 || ! tokens.back ().equal_token ("chunked")
+                || response.version < HTTP_1_1) {
+            header.erase (te);
+            te = header.end ();
+        }
     }
-    if (response.header.count ("content-length") > 0) {
+    auto cl = header.find ("content-length");
+    if (cl != header.end ()) {
         content_length_type canonlength;
-        decode (canonlength, response.header.at ("content-length"));
-        if (canonlength.status != 200)
-            response.header.erase ("content-length");
+        decode (canonlength, cl->second);
+        if (canonlength.status != 200 || te != header.end ()) {
+            header.erase (cl);
+            cl = header.end ();
+        }
         else
-            response.header["content-length"] = std::to_string (canonlength.length);
+            cl->second = std::to_string (canonlength.length);
     }
-    response.chunked = false;
-    if (response.http_version < "HTTP/1.1") {
-        if (response.header.count ("transfer-encoding") > 0)
-            response.header.erase ("transfer-encoding");
+    response.chunked = te != header.end ();
+    if (te == header.end () && cl == header.end ())
+        header["connection"] = "close";
+}
+
+// the header, in-memory bodies and chunk framing go out through the
+// iovec queue in one sendmsg each time the socket is writable.  only
+// file payloads take a separate sendfile, after a flush with MSG_MORE.
+void
+connection_type::prepare_response_body ()
+{
+    if (response.chunked && response.body_fd < 0)
+        prepare_response_chunks ();
+    else if (response.chunked)
+        prepare_response_chunk ();
+    else if (response.body_fd >= 0) {
+        wrsize = response.content_length;
+        wrqueue_kontinue (wrsize > 0, &connection_type::kont_response_file_length);
     }
-    else if (response.header.count ("transfer-encoding") > 0) {
-        response.chunked = true;
-        if (response.header.count ("content-length") > 0)
-            response.header.erase ("content-length");
+    else {
+        wrqueue_push (response.body.data (), response.body.size ());
+        wrpos = response.body.size ();
+        wrqueue_kontinue (false, &connection_type::kont_response_end);
     }
-    if (response.header.count ("transfer-encoding") == 0
-            && response.header.count ("content-length") == 0)
-        response.header["connection"] = "close";
 }
 
+// file chunks start at --chunk-size and double after each one up to
+// the send buffer, so that a long download settles on a few large
+// sendfile calls per buffer drain.
 void
-connection_type::kont_response_header (tcpserver_type& loop)
+connection_type::start_chunks (tcpserver_type& loop)
 {
-    int sock = loop.mplex.fd (handle_id);
-    ioresult = write (sock, &wrbuf[wrpos], wrsize - wrpos);
-    if (ioresult <= 0)
-        return iostop ();
-    wrpos += ioresult;
-    if (wrpos < wrsize)
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_header);
-    else if (! response.has_body)
-        iocontinue (&connection_type::kont_response_end);
-    else
-        prepare_response_body ();
+    int sndbuf = 0;
+    socklen_t len = sizeof sndbuf;
+    int const e = errno;
+    if (getsockopt (loop.mplex.fd (handle_id), SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0)
+        sndbuf = 0;
+    errno = e;
+    wrchunk = loop.chunk_size ();
+    wrchunk_max = std::max<ssize_t> (wrchunk, sndbuf);
 }
 
+// an in-memory body is framed into chunks of wrchunk octets, all of
+// them queued for the same sendmsg.  the frames are built first since
+// the queue points into wrframe.
 void
-connection_type::prepare_response_body ()
+connection_type::prepare_response_chunks ()
 {
-    wrpos = 0;
-    if (response.chunked) {
-        if (response.body_fd < 0)
-            response.content_length = response.body.size ();
-        response.chunk_size = std::min (
-            response.content_length - wrpos, BUFFER_SIZE - 16);
-        wrbuf = to_xdigits (response.chunk_size) + "\r\n";
-        wrpos1 = 0;
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_header);
-    }
-    else if (response.body_fd >= 0) {
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_file_length);
+    ssize_t const n = response.body.size ();
+    std::vector<std::size_t> mark;
+    wrframe.clear ();
+    for (ssize_t pos = 0; pos < n; pos += wrchunk) {
+        if (pos > 0)
+            wrframe += "\r\n";
+        wrframe += to_xdigits (std::min (n - pos, wrchunk)) + "\r\n";
+        mark.push_back (wrframe.size ());
     }
-    else {
-        wrsize = response.body.size ();
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_body_length);
+    wrframe += n > 0 ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+    std::size_t head = 0;
+    for (std::size_t i = 0; i < mark.size (); ++i) {
+        ssize_t const pos = i * wrchunk;
+        wrqueue_push (wrframe.data () + head, mark[i] - head);
+        wrqueue_push (response.body.data () + pos, std::min (n - pos, wrchunk));
+        head = mark[i];
     }
+    wrqueue_push (wrframe.data () + head, wrframe.size () - head);
+    wrpos = n;
+    wrqueue_kontinue (false, &connection_type::kont_response_end);
 }
 
+// chunk framing for file bodies: the CRLF closing the previous chunk
+// and the size line of the next one share a single queue entry.  the
+// frame goes with MSG_MORE so it rides in front of the chunk payload,
+// and the trailer goes without, which pushes the tail of the body.
 void
-connection_type::kont_response_chunk_header (tcpserver_type& loop)
+connection_type::prepare_response_chunk ()
 {
-    int sock = loop.mplex.fd (handle_id);
-    setsockopt_cork (sock, true);
-    ioresult = write (sock, &wrbuf[wrpos1], wrbuf.size () - wrpos1);
-    if (ioresult <= 0)
-        return iostop ();
-    wrpos1 += ioresult;
-    if (wrpos1 < wrbuf.size ())
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_header);
-    else if (response.chunk_size > 0) {
+    response.chunk_size = std::min (response.content_length - wrpos, wrchunk);
+    wrframe = wrpos > 0 ? "\r\n" : "";
+    wrframe += to_xdigits (response.chunk_size) + "\r\n";
+    if (response.chunk_size > 0) {
         wrsize = wrpos + response.chunk_size;
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_body);
+        wrqueue_push (wrframe.data (), wrframe.size ());
+        wrqueue_kontinue (true, &connection_type::kont_response_chunk_body);
     }
     else {
-        wrbuf = "\r\n";
-        wrpos1 = 0;
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_crlf);
+        wrframe += "\r\n";
+        wrqueue_push (wrframe.data (), wrframe.size ());
+        wrqueue_kontinue (false, &connection_type::kont_response_end);
     }
 }
 
 void
-connection_type::kont_response_chunk_body (tcpserver_type& loop)
+connection_type::wrqueue_clear ()
 {
-    int sock = loop.mplex.fd (handle_id);
-    if (response.body_fd < 0)
-        ioresult = write (sock, &response.body[wrpos], wrsize - wrpos);
-    else
-        ioresult = sendfile (sock, response.body_fd, nullptr, wrsize - wrpos);
+    wriov.clear ();
+    wriov_pos = 0;
+}
+
+void
+connection_type::wrqueue_push (char const* p, std::size_t const n)
+{
+    if (n > 0) {
+        struct iovec iov;
+        iov.iov_base = const_cast<char*> (p);
+        iov.iov_len = n;
+        wriov.push_back (iov);
+    }
+}
+
+void
+connection_type::wrqueue_kontinue (bool const more, kont_type const kontinuation)
+{
+    wrmore = more;
+    wrkont = kontinuation;
+}
+
+void
+connection_type::wrqueue_flush (int const sock)
+{
+    struct msghdr msg = {};
+    msg.msg_iov = &wriov[wriov_pos];
+    msg.msg_iovlen = std::min<std::size_t> (wriov.size () - wriov_pos, IOV_MAX);
+    int const flags = wrmore ? MSG_MORE : 0;
+    if (wrzerocopy) {
+        ioresult = sendmsg (sock, &msg, flags | MSG_ZEROCOPY);
+        if (ioresult > 0)
+            ++zc_sent;
+        else if (ioresult < 0 && ENOBUFS == errno)
+            wrzerocopy = false;
+    }
+    if (! wrzerocopy)
+        ioresult = sendmsg (sock, &msg, flags);
     if (ioresult <= 0)
-        return iostop ();
-    wrpos += ioresult;
-    if (wrpos < wrsize)
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_body);
-    else {
-        wrbuf = "\r\n";
-        wrpos1 = 0;
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_crlf);
+        return;
+    std::size_t n = ioresult;
+    while (wriov_pos < wriov.size () && n >= wriov[wriov_pos].iov_len)
+        n -= wriov[wriov_pos++].iov_len;
+    if (n > 0) {
+        wriov[wriov_pos].iov_base = static_cast<char*> (wriov[wriov_pos].iov_base) + n;
+        wriov[wriov_pos].iov_len -= n;
     }
 }
 
 void
-connection_type::kont_response_chunk_crlf (tcpserver_type& loop)
+connection_type::kont_response_gather (tcpserver_type& loop)
 {
     int sock = loop.mplex.fd (handle_id);
-    ioresult = write (sock, &wrbuf[wrpos1], wrbuf.size () - wrpos1);
-    if (ioresult <= 0)
-        return iostop ();
-    wrpos1 += ioresult;
-    if (wrpos1 < wrbuf.size ())
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_crlf);
-    else if (response.chunk_size == 0) {
-        setsockopt_cork (sock, false);
-        iocontinue (&connection_type::kont_response_end);
+    if (wriov_pos < wriov.size ()) {
+        wrqueue_flush (sock);
+        if (ioresult <= 0)
+            return iostop ();
     }
+    if (wriov_pos < wriov.size ())
+        iocontinue (WRITE_EVENT, &connection_type::kont_response_gather);
     else {
-        setsockopt_cork (sock, false);
-        response.chunk_size = std::min (
-            response.content_length - wrpos, BUFFER_SIZE - 16);
-        wrbuf = to_xdigits (response.chunk_size) + "\r\n";
-        wrpos1 = 0;
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_header);
+        wrqueue_clear ();
+        if (zc_done == zc_sent)
+            wrbatch.clear ();
+        iocontinue (WRITE_EVENT, wrkont);
     }
 }
 
+// the body, the header and any batch stay untouched until the kernel
+// has released every zerocopy send of this response.
 void
-connection_type::kont_response_file_length (tcpserver_type& loop)
+connection_type::kont_response_zerocopy (tcpserver_type& loop)
+{
+    if (zc_done == zc_sent)
+        iocontinue (&connection_type::kont_response_end);
+    else
+        iocontinue (ERROR_EVENT, &connection_type::kont_response_zerocopy_wait);
+}
+
+void
+connection_type::kont_response_zerocopy_wait (tcpserver_type& loop)
 {
     int sock = loop.mplex.fd (handle_id);
-    ioresult = sendfile (sock, response.body_fd, nullptr, BUFFER_SIZE);
-    if (ioresult < 0)
-        iostop ();
-    else if (ioresult > 0) {
-        wrpos += ioresult;
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_file_length);
+    while (zc_done != zc_sent)
+        if ((ioresult = zerocopy_reap (sock)) < 0)
+            return iostop ();
+    wrbatch.clear ();
+    iocontinue (&connection_type::kont_response_end);
+}
+
+// each completion on the error queue covers the range of zerocopy
+// sends [ee_info, ee_data] counted from zero on this socket.  TCP
+// completes them in order, so the upper end is the new count.
+ssize_t
+connection_type::zerocopy_reap (int const sock)
+{
+    char control[128];
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    ssize_t const n = recvmsg (sock, &msg, MSG_ERRQUEUE);
+    if (n < 0)
+        return n;
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR (&msg); cm != nullptr; cm = CMSG_NXTHDR (&msg, cm)) {
+        if (! (SOL_IP == cm->cmsg_level && IP_RECVERR == cm->cmsg_type)
+                && ! (SOL_IPV6 == cm->cmsg_level && IPV6_RECVERR == cm->cmsg_type))
+            continue;
+        struct sock_extended_err ee;
+        std::memcpy (&ee, CMSG_DATA (cm), sizeof ee);
+        if (0 != ee.ee_errno || SO_EE_ORIGIN_ZEROCOPY != ee.ee_origin)
+            continue;
+        zc_done = ee.ee_data + 1;
+        if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            zerocopy = -1;
     }
+    return 1;
+}
+
+// pipelining: while the input buffer still holds the next request, an
+// in-memory response is copied behind the earlier ones in wrbatch
+// instead of being written.  the batch leaves in front of the first
+// response that is not batched, before the connection waits for more
+// input, or before it closes, so responses keep their order and no
+// request is parsed while the batch is still being written.
+bool
+connection_type::wrqueue_batch ()
+{
+    if (wrkont != &connection_type::kont_response_end || rdbuf.empty ())
+        return false;
+    std::size_t const first = wrbatch.empty () ? 0 : 1;
+    std::size_t n = wrbatch.size ();
+    for (std::size_t i = first; i < wriov.size (); ++i)
+        n += wriov[i].iov_len;
+    if (n > OUTPUT_BATCH_LIMIT)
+        return false;
+    wrbatch.reserve (n);
+    for (std::size_t i = first; i < wriov.size (); ++i)
+        wrbatch.append (static_cast<char const*> (wriov[i].iov_base), wriov[i].iov_len);
+    wrqueue_clear ();
+    return true;
+}
+
+void
+connection_type::wrbatch_flush (kont_type const kontinuation)
+{
+    wrqueue_clear ();
+    wrqueue_push (wrbatch.data (), wrbatch.size ());
+    wrqueue_kontinue (false, kontinuation);
+    iocontinue (WRITE_EVENT, &connection_type::kont_response_gather);
+}
+
+void
+connection_type::kont_response_flushed (tcpserver_type& loop)
+{
+    iocontinue (READ_EVENT, rdkont);
+}
+
+void
+connection_type::kont_response_chunk_body (tcpserver_type& loop)
+{
+    int sock = loop.mplex.fd (handle_id);
+    off_t offset = wrpos;
+    ioresult = sendfile (sock, response.body_fd, &offset, wrsize - wrpos);
+    if (ioresult <= 0)
+        return iostop ();
+    wrpos = offset;
+    if (wrpos < wrsize)
+        iocontinue (WRITE_EVENT, &connection_type::kont_response_chunk_body);
     else {
-        ioresult = BUFFER_SIZE;
-        iocontinue (&connection_type::kont_response_end);
+        wrchunk = std::min (wrchunk * 2, wrchunk_max);
+        prepare_response_chunk ();
+        iocontinue (WRITE_EVENT, &connection_type::kont_response_gather);
     }
 }
 
+// wrpos is the file offset of the next octet and wrsize the end of
+// the range.  each sendfile asks for the whole remainder, the send
+// buffer bounds what it takes, and EAGAIN parks the connection until
+// the next writable edge.  a file that shrank under us cannot honour
+// its content-length, so the zero return closes the connection.
 void
-connection_type::kont_response_body_length (tcpserver_type& loop)
+connection_type::kont_response_file_length (tcpserver_type& loop)
 {
+    if (wrpos >= wrsize)
+        return iocontinue (&connection_type::kont_response_end);
     int sock = loop.mplex.fd (handle_id);
-    ioresult = write (sock, &response.body[wrpos], wrsize - wrpos);
+    off_t offset = wrpos;
+    ioresult = sendfile (sock, response.body_fd, &offset, wrsize - wrpos);
     if (ioresult <= 0)
         return iostop ();
-    wrpos += ioresult;
-    if (wrpos < wrsize)
-        iocontinue (WRITE_EVENT, &connection_type::kont_response_body_length);
-    else
-        iocontinue (&connection_type::kont_response_end);
+    wrpos = offset;
+    iocontinue (WRITE_EVENT, &connection_type::kont_response_file_length);
 }
 
 void
 connection_type::kont_response_end (tcpserver_type& loop)
 {
-    int sock = loop.mplex.fd (handle_id);
-    if (! finalize_response ())
+    loop.count_request ();
+    if (! finalize_response ()) {
+        int64_t uptime = loop.looptime () + loop.timeout ();
+        loop.mplex.mod_timer (uptime, handle_id);
+        rdstarted = false;
+        rdbuf.shrink ();
         iocontinue (&connection_type::kont_request_line);
-    else {
-        shutdown (sock, SHUT_WR);
-        iocontinue (READ_EVENT, &connection_type::kont_teardown);
     }
+    else if (! wrbatch.empty ())
+        wrbatch_flush (&connection_type::kont_response_close);
+    else
+        iocontinue (&connection_type::kont_response_close);
+}
+
+void
+connection_type::kont_response_close (tcpserver_type& loop)
+{
+    int sock = loop.mplex.fd (handle_id);
+    shutdown (sock, SHUT_WR);
+    iocontinue (READ_EVENT, &connection_type::kont_teardown);
 }
 
 bool
@@ -592,6 +1018,7 @@ connection_type::finalize_response ()
     response.content_length = wrpos;
     logger_type& log = logger_type::getinstance ();
     log.put (remote_addr, request, response);
+    release_handler ();
     bool teardown = done_connection ();
     response.clear ();
     request.clear ();
@@ -608,15 +1035,15 @@ connection_type::done_connection ()
     std::vector<simple_token_type> rsconn;
     if (MAX_KEEPALIVE_REQUESTS <= ++keepalive_requests)
         return true;
-    if (request.header.count ("connection") > 0)
-        decode (rqconn, request.header["connection"], 1);
+    if (request.header.count (HEADER_CONNECTION) > 0)
+        decode (rqconn, request.header.at (HEADER_CONNECTION), 1);
     if (response.header.count ("connection") > 0)
         decode (rsconn, response.header["connection"], 1);
     if (index (rqconn, "close") < rqconn.size ())
         return true;
     if (index (rsconn, "close") < rsconn.size ())
         return true;
-    if (response.http_version < "HTTP/1.1")
+    if (response.version < HTTP_1_1)
         return index (rqconn, "keep-alive") == rqconn.size ();
     return false;
 }
@@ -625,7 +1052,8 @@ void
 connection_type::kont_teardown (tcpserver_type& loop)
 {
     int sock = loop.mplex.fd (handle_id);
-    ioresult = read (sock, &rdbuf[0], BUFFER_SIZE);
+    ioresult = rdbuf.readv (sock);
+    rdbuf.clear ();
     if (ioresult > 0)
         iocontinue (READ_EVENT, &connection_type::kont_teardown);
     else
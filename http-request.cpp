@@ -1,13 +1,243 @@
+#include <string>
+#include <cctype>
 #include "http.hpp"
 
 namespace http {
 
+// names by id, and ids by slot of header_hash.
+static constexpr char const* HEADER_NAME[HEADER_KNOWN] = {
+    "connection",
+    "content-length",
+    "expect",
+    "host",
+    "if-match",
+    "if-modified-since",
+    "if-none-match",
+    "if-unmodified-since",
+    "transfer-encoding",
+};
+
+static constexpr int HEADER_SLOT[16] = {
+    HEADER_IF_UNMODIFIED_SINCE, -1, HEADER_TRANSFER_ENCODING, -1,
+    -1, HEADER_IF_MATCH, HEADER_EXPECT, HEADER_HOST,
+    HEADER_CONNECTION, -1, HEADER_IF_NONE_MATCH, -1,
+    HEADER_CONTENT_LENGTH, -1, HEADER_IF_MODIFIED_SINCE, -1,
+};
+
+static constexpr std::size_t
+length (char const* s)
+{
+    return '\0' == *s ? 0 : 1 + length (s + 1);
+}
+
+static constexpr bool
+placed (int const id)
+{
+    return id == HEADER_KNOWN
+        || (HEADER_SLOT[header_hash (HEADER_NAME[id], length (HEADER_NAME[id]))] == id
+            && placed (id + 1));
+}
+
+static_assert (placed (0), "every known header name hashes to its own slot");
+
+int
+header_id (char const* s, std::size_t const n)
+{
+    if (n < 3)
+        return -1;
+    int const id = HEADER_SLOT[header_hash (s, n)];
+    if (id < 0 || length (HEADER_NAME[id]) != n)
+        return -1;
+    for (std::size_t k = 0; k < n; ++k)
+        if (HEADER_NAME[id][k] != std::tolower (s[k]))
+            return -1;
+    return id;
+}
+
+header_map_type::header_map_type (
+    std::initializer_list<std::pair<std::string, std::string>> list)
+    : text (), fields (), last (), open (false)
+{
+    clear_known ();
+    for (auto const& x : list)
+        add (x.first, x.second);
+}
+
+void
+header_map_type::clear_known ()
+{
+    for (int i = 0; i < HEADER_KNOWN; ++i) {
+        known[i] = -1;
+        known_fresh[i] = false;
+    }
+}
+
+// a known name goes straight to its field, any other is searched for.
+std::size_t
+header_map_type::find (char const* name, std::size_t const n) const
+{
+    int const id = header_id (name, n);
+    if (id >= 0)
+        return known[id] < 0 ? fields.size () : known[id];
+    for (std::size_t i = 0; i < fields.size (); ++i) {
+        field_type const& f = fields[i];
+        if (f.name_size != n)
+            continue;
+        std::size_t k = 0;
+        while (k < n && text[f.name + k] == std::tolower (name[k]))
+            ++k;
+        if (k == n)
+            return i;
+    }
+    return fields.size ();
+}
+
+std::size_t
+header_map_type::count (std::string const& name) const
+{
+    return find (name) < fields.size () ? 1 : 0;
+}
+
+// the value of the field, or empty when there is none.
+std::string const&
+header_map_type::at (header_id_type const id) const
+{
+    if (! known_fresh[id]) {
+        if (known[id] < 0)
+            known_value[id].clear ();
+        else
+            known_value[id].assign (text, fields[known[id]].value, fields[known[id]].value_size);
+        known_fresh[id] = true;
+    }
+    return known_value[id];
+}
+
+std::string
+header_map_type::at (std::string const& name) const
+{
+    std::size_t const i = find (name);
+    if (i == fields.size ())
+        return std::string ();
+    return text.substr (fields[i].value, fields[i].value_size);
+}
+
+void
+header_map_type::put_name (char const* p, std::size_t const n)
+{
+    if (! open) {
+        last.name = text.size ();
+        last.name_size = 0;
+        open = true;
+    }
+    for (std::size_t k = 0; k < n; ++k)
+        text.push_back (std::tolower (p[k]));
+    last.name_size += n;
+}
+
+// the value follows its name in text.
+void
+header_map_type::put_value (char const* p, std::size_t const n)
+{
+    text.append (p, n);
+}
+
+// an obs-fold turns into one space, as the blanks before it trail.
+void
+header_map_type::fold_value ()
+{
+    std::size_t end = text.size ();
+    while (end > last.name + last.name_size && (' ' == text[end - 1] || '\t' == text[end - 1]))
+        --end;
+    text.resize (end);
+    text.push_back (' ');
+}
+
+// the value loses its trailing blanks.  a repeated field joins the
+// list with a comma: the joined value is written over the repeat, which
+// is the last thing in text.
+void
+header_map_type::close_field ()
+{
+    if (! open)
+        return;
+    open = false;
+    last.value = last.name + last.name_size;
+    std::size_t end = text.size ();
+    while (end > last.value && (' ' == text[end - 1] || '\t' == text[end - 1]))
+        --end;
+    text.resize (end);
+    last.value_size = end - last.value;
+    std::size_t const i = find (text.data () + last.name, last.name_size);
+    int const id = header_id (text.data () + last.name, last.name_size);
+    if (id >= 0)
+        known_fresh[id] = false;
+    if (i == fields.size ()) {
+        if (id >= 0)
+            known[id] = fields.size ();
+        fields.push_back (last);
+        return;
+    }
+    field_type& f = fields[i];
+    std::size_t const pos = text.size ();
+    text.reserve (pos + f.value_size + 1 + last.value_size);
+    text.append (text.data () + f.value, f.value_size);
+    text.push_back (',');
+    text.append (text.data () + last.value, last.value_size);
+    text.erase (last.name, pos - last.name);
+    f.value = last.name;
+    f.value_size += 1 + last.value_size;
+}
+
+void
+header_map_type::add (std::string const& name, std::string const& value)
+{
+    put_name (name.data (), name.size ());
+    put_value (value.data (), value.size ());
+    close_field ();
+}
+
+void
+header_map_type::set (std::string const& name, std::string const& value)
+{
+    std::size_t const i = find (name);
+    if (i == fields.size ())
+        return add (name, value);
+    int const id = header_id (name.data (), name.size ());
+    if (id >= 0)
+        known_fresh[id] = false;
+    field_type& f = fields[i];
+    if (value.size () <= f.value_size)
+        text.replace (f.value, value.size (), value);
+    else {
+        f.value = text.size ();
+        text.append (value);
+    }
+    f.value_size = value.size ();
+}
+
+bool
+header_map_type::operator == (header_map_type const& x) const
+{
+    if (fields.size () != x.fields.size ())
+        return false;
+    for (std::size_t i = 0; i < fields.size (); ++i) {
+        field_type const& f = fields[i];
+        field_type const& g = x.fields[i];
+        if (text.compare (f.name, f.name_size, x.text, g.name, g.name_size) != 0
+                || text.compare (f.value, f.value_size, x.text, g.value, g.value_size) != 0)
+            return false;
+    }
+    return true;
+}
+
 void
 request_type::clear ()
 {
     method.clear ();
     uri.clear ();
     http_version.clear ();
+    method_id = METHOD_OTHER;
+    version = 0;
     header.clear ();
     content_length = 0;
     body.clear ();
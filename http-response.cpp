@@ -96,6 +96,7 @@ void
 response_type::clear ()
 {
     http_version = "HTTP/1.1";
+    version = HTTP_1_1;
     code = 500;
     content_length = -1;
     header.clear ();
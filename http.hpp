@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <utility>
+#include <initializer_list>
+#include <cstdint>
 #include <ctime>
 
 namespace http {
@@ -64,12 +67,100 @@ struct etag_type {
     }
 };
 
+// the header fields the server itself consults.  header_id finds them
+// with a perfect hash, and header_map_type keeps the index of each, so
+// that looking one up is an array index.
+enum header_id_type {
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_EXPECT,
+    HEADER_HOST,
+    HEADER_IF_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_UNMODIFIED_SINCE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_KNOWN,
+};
+
+// gperf-style: the length and the third octet pick one of 16 slots,
+// which holds at most one known name.
+constexpr std::size_t
+header_hash (char const* s, std::size_t const n)
+{
+    return (n + (static_cast<uint8_t> (s[2]) | 0x20)) & 15;
+}
+
+int header_id (char const* s, std::size_t const n);
+
+// request header fields in arrival order.  names and values sit side
+// by side in one string, each field is four offsets into it, and clear
+// keeps both allocations for the next request on the connection.  names
+// are kept in lower case and looked up without regard to case.
+//
+// the request header decoder writes a field straight into the string:
+// put_name and put_value append spans of it as they are scanned, and
+// close_field records the offsets.  the value of a known field is copied
+// out once, into a string of its own that at returns by reference.
+class header_map_type {
+public:
+    header_map_type () : text (), fields (), last (), open (false) { clear_known (); }
+    header_map_type (std::initializer_list<std::pair<std::string, std::string>> list);
+    std::size_t size () const { return fields.size (); }
+    bool empty () const { return fields.empty (); }
+    std::size_t count (header_id_type const id) const { return known[id] < 0 ? 0 : 1; }
+    std::size_t count (std::string const& name) const;
+    std::string const& at (header_id_type const id) const;
+    std::string at (std::string const& name) const;
+    void add (std::string const& name, std::string const& value);
+    void set (std::string const& name, std::string const& value);
+    void put_name (char const* p, std::size_t const n);
+    void put_value (char const* p, std::size_t const n);
+    void fold_value ();
+    void close_field ();
+    void clear () { text.clear (); fields.clear (); open = false; clear_known (); }
+    bool operator == (header_map_type const& x) const;
+
+private:
+    struct field_type {
+        uint32_t name;
+        uint32_t name_size;
+        uint32_t value;
+        uint32_t value_size;
+    };
+    std::string text;
+    std::vector<field_type> fields;
+    field_type last;
+    bool open;
+    int known[HEADER_KNOWN];
+    mutable std::string known_value[HEADER_KNOWN];
+    mutable bool known_fresh[HEADER_KNOWN];
+    std::size_t find (char const* name, std::size_t const n) const;
+    std::size_t find (std::string const& name) const { return find (name.data (), name.size ()); }
+    void clear_known ();
+};
+
+// the request methods the server tells apart, and protocol versions
+// packed as major << 8 | minor so that they compare as integers.
+enum method_type {
+    METHOD_OTHER,
+    METHOD_GET,
+    METHOD_HEAD,
+    METHOD_POST,
+    METHOD_PUT,
+};
+
+enum {
+    HTTP_1_0 = 0x0100,
+    HTTP_1_1 = 0x0101,
+};
+
 class condition_type {
 public:
     enum {FAILED, OK};
     condition_type (etag_type const& et, std::time_t tm)
         : etag (et), mtime (tm) {}
-    int check (std::string const& method, std::map<std::string, std::string>& header);
+    int check (method_type const method, header_map_type const& header);
 
 private:
     etag_type etag;
@@ -85,15 +176,21 @@ struct request_type {
     std::string method;
     std::string uri;
     std::string http_version;
-    std::map<std::string, std::string> header;
+    method_type method_id;
+    int version;
+    header_map_type header;
     ssize_t content_length;
     std::string body;
+    request_type ()
+        : method (), uri (), http_version (), method_id (METHOD_OTHER), version (0),
+          header (), content_length (0), body () {}
     void clear ();
 };
 
 struct response_type {
     int code;
     std::string http_version;
+    int version;
     std::map<std::string, std::string> header;
     ssize_t content_length;
     std::string body;
@@ -125,6 +222,7 @@ public:
     decoder_request_line_type ();
     void set_limit_nbyte (std::size_t const x) { limit_nbyte = x; }
     bool put (uint32_t const octet, request_type& req);
+    std::size_t put (char const* p, std::size_t const n, request_type& req);
     void clear ();
     bool good () const;
     bool bad () const;
@@ -143,6 +241,7 @@ public:
     void set_limit_nfield (std::size_t const x) { limit_nfield = x; }
     void set_limit_nbyte (std::size_t const x) { limit_nbyte = x; }
     bool put (uint32_t const octet, request_type& req);
+    std::size_t put (char const* p, std::size_t const n, request_type& req);
     void clear ();
     bool good () const;
     bool bad () const;
@@ -150,14 +249,12 @@ public:
 
 private:
     int next_state;
-    std::string name;
-    std::string value;
-    std::string spaces;
     std::size_t nfield;
     std::size_t nbyte;
     std::size_t limit_nfield;
     std::size_t limit_nbyte;
     bool failure () { next_state = 0; return false; }
+    void put_value (char const* p, std::size_t const n, request_type& req);
 };
 
 class decoder_chunk_type {
@@ -168,6 +265,7 @@ public:
     int chunk_size;
     decoder_chunk_type ();
     bool put (int c, std::string& body);
+    std::size_t put (char const* p, std::size_t const n, std::string& body);
     void clear ();
     bool good () const;
     bool bad () const;
@@ -0,0 +1,101 @@
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "server.hpp"
+
+namespace http {
+
+// the unread octets live in buf[head, tail).  a read first compacts
+// them to the front when the free tail is short, then fills the free
+// tail and a spill area on the stack with one readv.  the spill part
+// is appended after growing buf, so a burst larger than the buffer
+// still costs one syscall.  the parsers always see one contiguous span.
+
+input_buffer_type::input_buffer_type (std::size_t const initial, std::size_t const limit)
+    : buf (initial, '\0'), head (0), tail (0), initial_ (initial), limit_ (limit)
+{
+}
+
+void
+input_buffer_type::consume (std::size_t const n)
+{
+    head += std::min (n, tail - head);
+    if (head == tail) {
+        head = 0;
+        tail = 0;
+    }
+}
+
+void
+input_buffer_type::clear ()
+{
+    head = 0;
+    tail = 0;
+}
+
+void
+input_buffer_type::shrink ()
+{
+    if (head == tail && buf.size () > initial_) {
+        std::string (initial_, '\0').swap (buf);
+        head = 0;
+        tail = 0;
+    }
+}
+
+void
+input_buffer_type::compact ()
+{
+    if (head > 0) {
+        std::memmove (&buf[0], &buf[head], tail - head);
+        tail -= head;
+        head = 0;
+    }
+}
+
+ssize_t
+input_buffer_type::readv (int const fd)
+{
+    char spill[SPILL_SIZE];
+    if (buf.size () - tail < buf.size () / 2)
+        compact ();
+    std::size_t const room = buf.size () - tail;
+    std::size_t const allow = limit_ - std::min (limit_, tail - head + room);
+    if (0 == room && 0 == allow) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    struct iovec iov[2];
+    int iovcnt = 0;
+    if (room > 0) {
+        iov[iovcnt].iov_base = &buf[tail];
+        iov[iovcnt].iov_len = room;
+        ++iovcnt;
+    }
+    if (allow > 0) {
+        iov[iovcnt].iov_base = spill;
+        iov[iovcnt].iov_len = std::min<std::size_t> (allow, SPILL_SIZE);
+        ++iovcnt;
+    }
+    ssize_t const n = ::readv (fd, iov, iovcnt);
+    if (n <= 0)
+        return n;
+    if (static_cast<std::size_t> (n) <= room) {
+        tail += n;
+        return n;
+    }
+    std::size_t const extra = n - room;
+    tail = buf.size ();
+    compact ();
+    std::size_t const want = std::min (limit_,
+        std::max (buf.size () * 2, tail + extra));
+    buf.resize (want);
+    std::memcpy (&buf[tail], spill, extra);
+    tail += extra;
+    return n;
+}
+
+}//namespace http
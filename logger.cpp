@@ -1,12 +1,31 @@
-#include <iostream>
 #include <string>
 #include <utility>
 #include <cerrno>
 #include <cstring>
+#include <unistd.h>
 #include "http.hpp"
 
 namespace http {
 
+// each line goes out whole in one write(2), without a lock or a stream
+// buffer shared between workers: the kernel keeps a write to a pipe of
+// up to PIPE_BUF octets, or any write to a file opened O_APPEND, from
+// interleaving with another.
+static void
+put_line (std::string t)
+{
+    t.push_back ('\n');
+    std::size_t pos = 0;
+    while (pos < t.size ()) {
+        ssize_t const n = ::write (STDOUT_FILENO, t.data () + pos, t.size () - pos);
+        if (n < 0 && EINTR == errno)
+            continue;
+        if (n <= 0)
+            break;
+        pos += n;
+    }
+}
+
 logger_type::logger_type () {}
 logger_type::~logger_type () {}
 logger_type::logger_type(logger_type const&) {}
@@ -27,7 +46,7 @@ logger_type::put_error (std::string const& s)
         e = s + ":" + e;
     std::string ts = time_to_string ("%a %b %e %H:%M:%S %Y");
     std::string t = "[" + ts + "] [error] " + e;
-    std::cout << t << std::endl;
+    put_line (std::move (t));
 }
 
 void
@@ -35,7 +54,7 @@ logger_type::put_info (std::string const& s)
 {
     std::string ts = time_to_string ("%a %b %e %H:%M:%S %Y");
     std::string t = "[" + ts + "] [info] " + s;
-    std::cout << t << std::endl;
+    put_line (std::move (t));
 }
 
 void
@@ -43,7 +62,7 @@ logger_type::put_error (std::string const& ho, std::string const& s)
 {
     std::string ts = time_to_string ("%a %b %e %H:%M:%S %Y");
     std::string t = "[" + ts + "] [error] [client " + ho +"] " + s;
-    std::cout << t << std::endl;
+    put_line (std::move (t));
 }
 
 static std::string
@@ -81,7 +100,7 @@ logger_type::put (std::string const& ho, request_type& req, response_type& res)
             + " " + quote (req.http_version) + "\"";
     std::string t = ho + " - - [" + ts + "] " + rl + " "
         + std::to_string (res.code) + " " + std::to_string (res.content_length);
-    std::cout << t << std::endl;
+    put_line (std::move (t));
 }
 
 }//namespace http
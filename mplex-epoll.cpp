@@ -1,19 +1,33 @@
 #include <cerrno>
+#include <limits>
+#include <time.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include "server.hpp"
 
 namespace http {
 
-mplex_epoll_type::mplex_epoll_type (std::size_t n)
-    : mplex_io_type (n), epoll_fd (-1), evset ()
+mplex_epoll_type::mplex_epoll_type (std::size_t n, std::size_t chunk, bool once)
+    : mplex_io_type (n, chunk, once), epoll_fd (-1), timer_fd (-1),
+      timer_expiry (std::numeric_limits<int64_t>::max ()),
+      spin_budget (config_type::getinstance ().busy_poll),
+      spin_current (spin_budget), evset ()
 {
     evset = new struct epoll_event[n];
     epoll_fd = epoll_create (n);
+    timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = FREE;
+    if (epoll_fd < 0 || timer_fd < 0
+            || epoll_ctl (epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) < 0)
+        logger_type::getinstance ().put_error ("timerfd");
 }
 
 mplex_epoll_type::~mplex_epoll_type ()
 {
+    close (timer_fd);
     close (epoll_fd);
     delete[] evset;
     evset = nullptr;
@@ -26,34 +40,37 @@ mplex_epoll_type::add (uint32_t const trigger, int const fd, std::size_t const h
         errno = EBADF;
         return fd;
     }
-    if (handles.empty (FREE)) {
+    if (! reserve_free ()) {
         errno = ENOMEM;
         return -1;
     }
     std::size_t const id = handles[FREE].next;
     bool ev_permit = true;
-    int epck = epoll_create (1);
     struct epoll_event ev;
     ev.events = 0;
     ev.events |= trigger & READ_EVENT ? EPOLLIN : 0;
     ev.events |= trigger & WRITE_EVENT ? EPOLLOUT : 0;
     ev.events |= trigger & EDGE_EVENT ? EPOLLET : 0;
+    // with interest_once, edge-triggered handles are registered for both
+    // directions here and mod never calls epoll_ctl again: readiness of
+    // the direction not waited for accumulates in events until drop.
+    if (interest_once && (trigger & EDGE_EVENT))
+        ev.events |= EPOLLIN|EPOLLOUT;
     ev.data.u32 = id;
-    if (epoll_ctl (epck, EPOLL_CTL_ADD, fd, &ev) < 0) {
-        if (EPERM == errno)
-            ev_permit = false;
-        else
-            epoll_ctl (epck, EPOLL_CTL_DEL, fd, &ev);
+    ++ctl_count;
+    if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        // regular files and directories do not support epoll. treat
+        // them as always ready instead.
+        if (EPERM != errno)
+            return -1;
+        ev_permit = false;
     }
-    close (epck);
-    if (ev_permit && epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
-        return -1;
     handles[id].ev_permit = ev_permit;
     handles[id].fd = fd;
     handles[id].uptime = 0;
     handles[id].handler_id = handler_id;
     handles[id].state = ev_permit ? WAIT : READY;
-    handles[id].ev_mask = trigger & (READ_EVENT|WRITE_EVENT);
+    handles[id].ev_mask = trigger & (READ_EVENT|WRITE_EVENT|ERROR_EVENT);
     handles[id].events = ev_permit ? 0 : (trigger & (READ_EVENT|WRITE_EVENT));
     handles.erase (id);
     handles.insert (handles[id].state, id);
@@ -83,15 +100,21 @@ mplex_epoll_type::mod (uint32_t const trigger, std::size_t id)
     if (range_check (id) < 0)
         return -1;
     std::size_t next_id = handles[id].next;
-    handles[id].ev_mask &= ~(READ_EVENT|WRITE_EVENT);
-    handles[id].ev_mask |= (trigger & (READ_EVENT|WRITE_EVENT));
-    if (trigger & (READ_EVENT|WRITE_EVENT)) {
-        if (handles[id].ev_permit) {
+    handles[id].ev_mask &= ~(READ_EVENT|WRITE_EVENT|ERROR_EVENT);
+    handles[id].ev_mask |= (trigger & (READ_EVENT|WRITE_EVENT|ERROR_EVENT));
+    // EPOLLERR needs no registration, so waiting for ERROR_EVENT alone
+    // keeps the socket in the set with neither EPOLLIN nor EPOLLOUT.
+    if (trigger & (READ_EVENT|WRITE_EVENT|ERROR_EVENT)) {
+        if (handles[id].ev_permit && interest_once && (trigger & EDGE_EVENT))
+            ;
+        else if (handles[id].ev_permit) {
             ev.events = 0;
             ev.events |= trigger & READ_EVENT ? EPOLLIN : 0;
             ev.events |= trigger & WRITE_EVENT ? EPOLLOUT : 0;
             ev.events |= trigger & EDGE_EVENT ? EPOLLET : 0;
             ev.data.u32 = id;
+            ++ctl_count;
+            ++mod_count;
             if (epoll_ctl (epoll_fd, EPOLL_CTL_MOD, handles[id].fd, &ev) < 0)
                 return -1;
         }
@@ -102,6 +125,7 @@ mplex_epoll_type::mod (uint32_t const trigger, std::size_t id)
     }
     else {
         if (handles[id].ev_permit) {
+            ++ctl_count;
             if (epoll_ctl (epoll_fd, EPOLL_CTL_DEL, handles[id].fd, &ev) < 0)
                 return -1;
         }
@@ -126,6 +150,7 @@ mplex_epoll_type::del (std::size_t const id)
         return -1;
     std::size_t const next_id = handles[id].next;
     if (handles[id].ev_permit) {
+        ++ctl_count;
         if (epoll_ctl (epoll_fd, EPOLL_CTL_DEL, handles[id].fd, &ev) < 0)
             return -1;
     }
@@ -141,12 +166,68 @@ mplex_epoll_type::del (std::size_t const id)
     return handles[next_id].prev;
 }
 
+void
+mplex_epoll_type::arm_timer ()
+{
+    int64_t const expiry = timers.next_expiry ();
+    if (expiry == timer_expiry)
+        return;
+    struct itimerspec spec = {{0, 0}, {0, 0}};
+    if (expiry < std::numeric_limits<int64_t>::max ()) {
+        spec.it_value.tv_sec = expiry / 1000;
+        spec.it_value.tv_nsec = (expiry % 1000) * 1000000L;
+    }
+    ++timer_count;
+    timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    timer_expiry = expiry;
+}
+
+static inline int64_t
+monotonic_usec ()
+{
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return int64_t (t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
+
+// busy poll: before blocking, poll with zero timeout for up to
+// spin_current microseconds.  each spin that finds nothing halves the
+// budget so that an idle loop falls back to blocking waits, and any
+// event restores it.
+int
+mplex_epoll_type::spin (int const msec)
+{
+    int nevent = 0;
+    if (0 != msec && spin_current > 0) {
+        int64_t const deadline = monotonic_usec () + spin_current;
+        do {
+            ++wait_count;
+            nevent = epoll_wait (epoll_fd, evset, max_events, 0);
+        } while (0 == nevent && monotonic_usec () < deadline);
+        if (0 == nevent)
+            spin_current /= 2;
+    }
+    if (0 == nevent) {
+        ++wait_count;
+        nevent = epoll_wait (epoll_fd, evset, max_events, msec);
+    }
+    if (nevent > 0)
+        spin_current = spin_budget;
+    return nevent;
+}
+
 int
 mplex_epoll_type::wait (int msec)
 {
     if (! handles.empty (READY))
         msec = 0;
-    int const nevent = epoll_wait (epoll_fd, evset, max_events, msec);
+    arm_timer ();
+    int const nevent = spin (msec);
+    int const e = errno;
+    update_looptime ();
+    if (looptime_ >= timer_expiry)
+        expire_timers ();
+    errno = e;
     if (nevent < 0 && EINTR == errno)
         return 0;
     if (nevent < 0)
@@ -156,10 +237,18 @@ mplex_epoll_type::wait (int msec)
         uint32_t events = 0;
         events |= ep_events & EPOLLIN ? READ_EVENT : 0;
         events |= ep_events & EPOLLOUT ? WRITE_EVENT : 0;
+        events |= ep_events & EPOLLERR ? ERROR_EVENT : 0;
         int const id = evset[i].data.u32;
+        if (FREE == id) {
+            uint64_t count;
+            while (read (timer_fd, &count, sizeof count) > 0)
+                ;
+            continue;
+        }
         handles[id].events |= events;
         if (WAIT == handles[id].state && (handles[id].ev_mask & handles[id].events)) {
             handles.erase (id);
+            handles[id].state = READY;
             handles.insert (READY, id);
         }
     }
@@ -1,22 +1,37 @@
 #include <ctime>
 #include <cerrno>
+#include <time.h>
 #include "server.hpp"
 
 namespace http {
 
-mplex_io_type::mplex_io_type (std::size_t n)
-    : max_events (n), handles (), timers ()
+mplex_io_type::mplex_io_type (std::size_t n, std::size_t chunk, bool once)
+    : max_events (n), interest_once (once),
+      ctl_count (0), mod_count (0), wait_count (0), timer_count (0),
+      grow_chunk (chunk < 1 ? 1 : chunk), handles (), timers ()
 {
-    looptime_ = std::time (nullptr);
+    update_looptime ();
     handles.resize (n + 3);
     handles.erase (WAIT);
     handles.erase (READY);
+    timers.resize (handles.size ());
+    timers.reset (looptime_);
 }
 
-int
-mplex_io_type::add_timer (std::time_t const uptime, std::size_t const handler_id)
+bool
+mplex_io_type::reserve_free ()
 {
     if (handles.empty (FREE)) {
+        handles.grow (grow_chunk, FREE);
+        timers.resize (handles.size ());
+    }
+    return ! handles.empty (FREE);
+}
+
+int
+mplex_io_type::add_timer (int64_t const uptime, std::size_t const handler_id)
+{
+    if (! reserve_free ()) {
         errno = ENOMEM;
         return -1;
     }
@@ -31,12 +46,12 @@ mplex_io_type::add_timer (std::time_t const uptime, std::size_t const handler_id
     handles.erase (id);
     handles.insert (handles[id].state, id);
     if (WAIT == handles[id].state)
-        timers.emplace (uptime, id);
+        timers.insert (id, uptime);
     return id;
 }
 
 int
-mplex_io_type::mod_timer (std::time_t const uptime, std::size_t const id)
+mplex_io_type::mod_timer (int64_t const uptime, std::size_t const id)
 {
     if (range_check (id) < 0)
         return -1;
@@ -51,8 +66,8 @@ mplex_io_type::mod_timer (std::time_t const uptime, std::size_t const id)
         handles.erase (id);
         handles.insert (handles[id].state, id);
     }
-    if (WAIT == handles[id].state)
-        timers.emplace (uptime, id);
+    if (looptime_ < uptime)
+        timers.insert (id, uptime);
     return handles[next_id].prev;
 }
 
@@ -64,32 +79,73 @@ mplex_io_type::stop_timer (std::size_t const id)
     std::size_t const next_id = handles[id].next;
     handles[id].uptime = 0;
     handles[id].events &= ~TIMER_EVENT;
-    if (TIMER_EVENT & handles[id].ev_mask) {
-        auto i = timers.lower_bound (handles[id].uptime);
-        for (; i != timers.end (); ++i) {
-            if (i->first > handles[id].uptime)
-                break;
-            else if (i->second == id) {
-                timers.erase (i);
-                break;
-            }
-        }
-    }
+    timers.erase (id);
     handles[id].ev_mask &= ~TIMER_EVENT;
     return handles[next_id].prev;
 }
 
+// marks events pending on a handle as if the backend had reported
+// them, so that its handler runs again on the next pass of the loop.
+int
+mplex_io_type::wake (uint32_t const events, std::size_t const id)
+{
+    if (range_check (id) < 0)
+        return -1;
+    std::size_t const next_id = handles[id].next;
+    handles[id].events |= events;
+    if (WAIT == handles[id].state && (handles[id].ev_mask & handles[id].events)) {
+        handles.erase (id);
+        handles[id].state = READY;
+        handles.insert (READY, id);
+    }
+    return handles[next_id].prev;
+}
+
+// a backend that accepts on behalf of a listener registered with
+// ACCEPT_EVENT hands over one accepted socket per call, or fails with
+// EAGAIN once none is queued.  ENOSYS asks the caller to accept4.
+int
+mplex_io_type::accept (std::size_t const id)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+// bounds the sockets such a backend holds for a listener to n, as the
+// listen backlog bounds those the kernel holds.
+int
+mplex_io_type::accept_limit (std::size_t const id, std::size_t const n)
+{
+    return 0;
+}
+
+void
+mplex_io_type::update_looptime ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    looptime_ = int64_t (ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
 void
 mplex_io_type::run_timer ()
 {
-    looptime_ = std::time (nullptr);
-    for (auto i = timers.begin (); i != timers.end () && i->first <= looptime_;) {
-        handles[i->second].events |= TIMER_EVENT;
-        if (WAIT == handles[i->second].state) {
-            handles.erase (i->second);
-            handles.insert (READY, i->second);
+    update_looptime ();
+    expire_timers ();
+}
+
+void
+mplex_io_type::expire_timers ()
+{
+    timers.advance (looptime_);
+    while (! timers.expired_empty ()) {
+        std::size_t const id = timers.pop_expired ();
+        handles[id].events |= TIMER_EVENT;
+        if (WAIT == handles[id].state) {
+            handles.erase (id);
+            handles[id].state = READY;
+            handles.insert (READY, id);
         }
-        i = timers.erase (i);
     }
 }
 
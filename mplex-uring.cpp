@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "server.hpp"
+
+namespace http {
+
+// readiness multiplexer on io_uring.
+//
+// each handle owns one multishot IORING_OP_POLL_ADD request tagged with
+// (generation << 32 | id).  add, mod and del only queue submission
+// entries; they reach the kernel together with the next wait in one
+// io_uring_enter, which also reaps the completions.  a generation bump
+// on mod and del makes late completions of the replaced request stale.
+//
+// multishot poll reports a change of readiness, not readiness itself,
+// so a handle is dropped only once its descriptor has said EAGAIN.  a
+// listener added with ACCEPT_EVENT gets a multishot IORING_OP_ACCEPT
+// instead: the kernel accepts as clients arrive and each completion
+// carries a socket, queued for accept until the listener drains it.
+// the accept is cancelled while the listener does not want READ_EVENT,
+// so that a full pool leaves clients in the backlog.
+
+namespace {
+    uint64_t const REMOVE_TAG = std::numeric_limits<uint64_t>::max ();
+    uint64_t const ACCEPT_TAG = uint64_t (1) << 31;
+}
+
+static inline int
+sys_io_uring_setup (unsigned entries, struct io_uring_params* p)
+{
+    return syscall (__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+sys_io_uring_enter (int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags, void* arg, std::size_t argsz)
+{
+    return syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+        flags, arg, argsz);
+}
+
+template<class T>
+static inline T*
+ring_ptr (void* base, uint32_t const offset)
+{
+    return reinterpret_cast<T*> (static_cast<char*> (base) + offset);
+}
+
+mplex_uring_type::mplex_uring_type (std::size_t n, std::size_t chunk, bool once)
+    : mplex_io_type (n, chunk, once), ring_fd (-1), sq_entries (0),
+      sq_ring (MAP_FAILED), sq_ring_size (0),
+      cq_ring (MAP_FAILED), cq_ring_size (0),
+      sqes (nullptr), sqes_size (0),
+      sq_head (), sq_tail (), sq_mask (), sq_array (),
+      cq_head (), cq_tail (), cq_mask (), cqes (),
+      sq_pending (0), generations (), triggers (), listeners ()
+{
+    unsigned entries = 64;
+    while (entries < n && entries < 4096)
+        entries <<= 1;
+    if (! setup (entries))
+        teardown ();
+}
+
+mplex_uring_type::~mplex_uring_type ()
+{
+    teardown ();
+}
+
+bool
+mplex_uring_type::setup (unsigned const entries)
+{
+    struct io_uring_params p;
+    std::memset (&p, 0, sizeof p);
+    ring_fd = sys_io_uring_setup (entries, &p);
+    if (ring_fd < 0)
+        return false;
+    // multishot poll and timed waits need 5.13 or later.
+    if (! (p.features & IORING_FEAT_EXT_ARG) || ! (p.features & IORING_FEAT_RSRC_TAGS)
+            || ! (p.features & IORING_FEAT_NODROP)) {
+        errno = ENOSYS;
+        return false;
+    }
+    sq_entries = p.sq_entries;
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    bool const single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        sq_ring_size = cq_ring_size = std::max (sq_ring_size, cq_ring_size);
+    sq_ring = mmap (nullptr, sq_ring_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == sq_ring)
+        return false;
+    if (single)
+        cq_ring = sq_ring;
+    else {
+        cq_ring = mmap (nullptr, cq_ring_size, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == cq_ring)
+            return false;
+    }
+    sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+    void* s = mmap (nullptr, sqes_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == s)
+        return false;
+    sqes = static_cast<struct io_uring_sqe*> (s);
+    sq_head = ring_ptr<unsigned> (sq_ring, p.sq_off.head);
+    sq_tail = ring_ptr<unsigned> (sq_ring, p.sq_off.tail);
+    sq_mask = ring_ptr<unsigned> (sq_ring, p.sq_off.ring_mask);
+    sq_array = ring_ptr<unsigned> (sq_ring, p.sq_off.array);
+    cq_head = ring_ptr<unsigned> (cq_ring, p.cq_off.head);
+    cq_tail = ring_ptr<unsigned> (cq_ring, p.cq_off.tail);
+    cq_mask = ring_ptr<unsigned> (cq_ring, p.cq_off.ring_mask);
+    cqes = ring_ptr<struct io_uring_cqe> (cq_ring, p.cq_off.cqes);
+    return true;
+}
+
+void
+mplex_uring_type::teardown ()
+{
+    int const e = errno;
+    if (sqes != nullptr)
+        munmap (sqes, sqes_size);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        munmap (cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+        munmap (sq_ring, sq_ring_size);
+    if (ring_fd >= 0)
+        close (ring_fd);
+    sqes = nullptr;
+    cq_ring = MAP_FAILED;
+    sq_ring = MAP_FAILED;
+    ring_fd = -1;
+    errno = e;
+}
+
+int
+mplex_uring_type::enter (unsigned const min_complete, int const msec)
+{
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void* argp = nullptr;
+    std::size_t argsz = 0;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (msec >= 0) {
+            ts.tv_sec = msec / 1000;
+            ts.tv_nsec = (msec % 1000) * 1000000L;
+            std::memset (&arg, 0, sizeof arg);
+            arg.ts = reinterpret_cast<uint64_t> (&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof arg;
+        }
+    }
+    int const r = sys_io_uring_enter (ring_fd, sq_pending, min_complete,
+        flags, argp, argsz);
+    if (r > 0)
+        sq_pending -= std::min<unsigned> (r, sq_pending);
+    return r;
+}
+
+struct io_uring_sqe*
+mplex_uring_type::get_sqe ()
+{
+    unsigned const tail = *sq_tail;
+    if (tail - __atomic_load_n (sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        ++ctl_count;
+        if (enter (0, 0) < 0)
+            return nullptr;
+        if (tail - __atomic_load_n (sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+            return nullptr;
+    }
+    unsigned const index = tail & *sq_mask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    std::memset (sqe, 0, sizeof *sqe);
+    sq_array[index] = index;
+    return sqe;
+}
+
+void
+mplex_uring_type::push_sqe ()
+{
+    __atomic_store_n (sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+    ++sq_pending;
+}
+
+static inline uint32_t
+poll_mask (uint32_t const trigger)
+{
+    uint32_t mask = 0;
+    mask |= trigger & READ_EVENT ? POLLIN|POLLRDHUP : 0;
+    mask |= trigger & WRITE_EVENT ? POLLOUT : 0;
+    mask |= trigger & ERROR_EVENT ? POLLERR : 0;
+    mask |= mask && (trigger & EDGE_EVENT) ? EPOLLET : 0;
+    return mask;
+}
+
+int
+mplex_uring_type::poll_add (std::size_t const id)
+{
+    struct io_uring_sqe* sqe = get_sqe ();
+    if (nullptr == sqe)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = handles[id].fd;
+    sqe->poll32_events = poll_mask (triggers[id]);
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = (uint64_t (generations[id]) << 32) | id;
+    push_sqe ();
+    return 0;
+}
+
+int
+mplex_uring_type::poll_remove (std::size_t const id)
+{
+    struct io_uring_sqe* sqe = get_sqe ();
+    if (nullptr == sqe)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t (generations[id]) << 32) | id;
+    sqe->user_data = REMOVE_TAG;
+    push_sqe ();
+    ++generations[id];
+    return 0;
+}
+
+int
+mplex_uring_type::accept_add (std::size_t const id)
+{
+    struct io_uring_sqe* sqe = get_sqe ();
+    if (nullptr == sqe)
+        return -1;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = handles[id].fd;
+    sqe->accept_flags = SOCK_NONBLOCK|SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = (uint64_t (generations[id]) << 32) | ACCEPT_TAG | id;
+    push_sqe ();
+    return 0;
+}
+
+int
+mplex_uring_type::accept_cancel (std::size_t const id)
+{
+    struct io_uring_sqe* sqe = get_sqe ();
+    if (nullptr == sqe)
+        return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t (generations[id]) << 32) | ACCEPT_TAG | id;
+    sqe->user_data = REMOVE_TAG;
+    push_sqe ();
+    ++generations[id];
+    return 0;
+}
+
+int
+mplex_uring_type::arm (std::size_t const id)
+{
+    if (triggers[id] & ACCEPT_EVENT)
+        return triggers[id] & READ_EVENT ? accept_add (id) : 0;
+    return poll_mask (triggers[id]) ? poll_add (id) : 0;
+}
+
+int
+mplex_uring_type::disarm (std::size_t const id)
+{
+    if (triggers[id] & ACCEPT_EVENT)
+        return triggers[id] & READ_EVENT ? accept_cancel (id) : 0;
+    return poll_mask (triggers[id]) ? poll_remove (id) : 0;
+}
+
+int
+mplex_uring_type::add (uint32_t const trigger, int const fd, std::size_t const handler_id)
+{
+    if (fd < 0) {
+        errno = EBADF;
+        return fd;
+    }
+    if (! reserve_free ()) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (generations.size () < handles.size ()) {
+        generations.resize (handles.size (), 0);
+        triggers.resize (handles.size (), 0);
+    }
+    std::size_t const id = handles[FREE].next;
+    handles[id].fd = fd;
+    triggers[id] = trigger;
+    if (trigger & ACCEPT_EVENT) {
+        listeners[id].since = generations[id];
+        listeners[id].limit = BACKLOG;
+    }
+    if (interest_once && (trigger & EDGE_EVENT))
+        triggers[id] |= READ_EVENT|WRITE_EVENT;
+    if (arm (id) < 0) {
+        handles[id].fd = -1;
+        triggers[id] = 0;
+        listeners.erase (id);
+        return -1;
+    }
+    handles[id].ev_permit = true;
+    handles[id].uptime = 0;
+    handles[id].handler_id = handler_id;
+    handles[id].state = WAIT;
+    handles[id].ev_mask = trigger & (READ_EVENT|WRITE_EVENT|ERROR_EVENT);
+    handles[id].events = 0;
+    handles.erase (id);
+    handles.insert (handles[id].state, id);
+    return id;
+}
+
+int
+mplex_uring_type::drop (uint32_t const events, std::size_t const id)
+{
+    if (range_check (id) < 0)
+        return -1;
+    std::size_t const next_id = handles[id].next;
+    handles[id].events &= ~events;
+    if (READY == handles[id].state && ! (handles[id].events & handles[id].ev_mask)) {
+        handles[id].state = WAIT;
+        handles.erase (id);
+        handles.insert (handles[id].state, id);
+    }
+    return handles[next_id].prev;
+}
+
+int
+mplex_uring_type::mod (uint32_t const trigger, std::size_t const id)
+{
+    if (range_check (id) < 0)
+        return -1;
+    std::size_t const next_id = handles[id].next;
+    handles[id].ev_mask &= ~(READ_EVENT|WRITE_EVENT|ERROR_EVENT);
+    handles[id].ev_mask |= (trigger & (READ_EVENT|WRITE_EVENT|ERROR_EVENT));
+    // a listener keeps ACCEPT_EVENT; only READ_EVENT arms or cancels
+    // its multishot accept.
+    if (interest_once && (trigger & EDGE_EVENT))
+        ;
+    else if (triggers[id] & ACCEPT_EVENT) {
+        if ((trigger & READ_EVENT) != (triggers[id] & READ_EVENT)) {
+            ++mod_count;
+            if (disarm (id) < 0)
+                return -1;
+            triggers[id] = trigger | ACCEPT_EVENT;
+            if (arm (id) < 0)
+                return -1;
+        }
+    }
+    else if (poll_mask (trigger) != poll_mask (triggers[id])) {
+        ++mod_count;
+        if (disarm (id) < 0)
+            return -1;
+        triggers[id] = trigger;
+        if (arm (id) < 0)
+            return -1;
+    }
+    int prev_state = handles[id].state;
+    if (handles[id].ev_mask & handles[id].events)
+        handles[id].state = READY;
+    else
+        handles[id].state = WAIT;
+    if (prev_state != handles[id].state) {
+        handles.erase (id);
+        handles.insert (handles[id].state, id);
+    }
+    return handles[next_id].prev;
+}
+
+int
+mplex_uring_type::del (std::size_t const id)
+{
+    if (range_check (id) < 0)
+        return -1;
+    std::size_t const next_id = handles[id].next;
+    if (disarm (id) < 0)
+        return -1;
+    stop_timer (id);
+    std::map<std::size_t, listener_type>::iterator const l = listeners.find (id);
+    if (listeners.end () != l) {
+        for (int const fd : l->second.accepted)
+            close (fd);
+        listeners.erase (l);
+        ++generations[id];
+    }
+    triggers[id] = 0;
+    handles[id].ev_permit = false;
+    handles[id].fd = -1;
+    handles[id].handler_id = 0;
+    handles[id].state = FREE;
+    handles[id].ev_mask = 0;
+    handles[id].events = 0;
+    handles.erase (id);
+    handles.insert (handles[id].state, id);
+    return handles[next_id].prev;
+}
+
+int
+mplex_uring_type::accept (std::size_t const id)
+{
+    if (range_check (id) < 0)
+        return -1;
+    std::map<std::size_t, listener_type>::iterator const l = listeners.find (id);
+    if (listeners.end () != l && ! l->second.accepted.empty ()) {
+        int const fd = l->second.accepted.front ();
+        l->second.accepted.pop_front ();
+        return fd;
+    }
+    errno = triggers[id] & ACCEPT_EVENT ? EAGAIN : ENOSYS;
+    return -1;
+}
+
+int
+mplex_uring_type::accept_limit (std::size_t const id, std::size_t const n)
+{
+    if (range_check (id) < 0)
+        return -1;
+    std::map<std::size_t, listener_type>::iterator const l = listeners.find (id);
+    if (listeners.end () != l)
+        l->second.limit = n;
+    return 0;
+}
+
+int
+mplex_uring_type::wait (int msec)
+{
+    if (! handles.empty (READY))
+        msec = 0;
+    update_looptime ();
+    int64_t const expiry = timers.next_expiry ();
+    if (expiry < std::numeric_limits<int64_t>::max ()) {
+        int64_t const delta = std::max<int64_t> (0, expiry - looptime_);
+        if (msec < 0 || delta < msec)
+            msec = delta;
+    }
+    bool const ready = __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE) != *cq_head;
+    int r = 0;
+    if (sq_pending > 0 || (msec != 0 && ! ready)) {
+        ++wait_count;
+        r = enter (msec != 0 && ! ready ? 1 : 0, msec);
+    }
+    int const e = errno;
+    update_looptime ();
+    if (looptime_ >= expiry)
+        expire_timers ();
+    if (r < 0 && EINTR != e && ETIME != e && EBUSY != e) {
+        errno = e;
+        return r;
+    }
+    int nevent = 0;
+    unsigned head = *cq_head;
+    unsigned const tail = __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        struct io_uring_cqe const& cqe = cqes[head & *cq_mask];
+        uint64_t const tag = cqe.user_data;
+        if (REMOVE_TAG == tag)
+            continue;
+        std::size_t const id = tag & (ACCEPT_TAG - 1);
+        uint32_t const generation = tag >> 32;
+        uint32_t events = 0;
+        if (tag & ACCEPT_TAG) {
+            // a socket accepted before a cancel landed still goes to its
+            // listener, up to its limit; past that, or once the listener
+            // is gone, the socket is closed as a full backlog would
+            // refuse it.
+            std::map<std::size_t, listener_type>::iterator const l = listeners.find (id);
+            if (listeners.end () == l
+                    || generations[id] - generation > generations[id] - l->second.since) {
+                if (cqe.res >= 0)
+                    close (cqe.res);
+                continue;
+            }
+            bool const current = generations[id] == generation;
+            // an accept that fails, or a kernel without multishot accept,
+            // hands the listener back to poll and accept4, which report
+            // the error in the usual way.
+            if (cqe.res >= 0 && l->second.accepted.size () >= l->second.limit)
+                close (cqe.res);
+            else if (cqe.res >= 0)
+                l->second.accepted.push_back (cqe.res);
+            else if (current)
+                triggers[id] &= ~ACCEPT_EVENT;
+            else
+                continue;
+            events = READ_EVENT;
+            if (current && ! (cqe.flags & IORING_CQE_F_MORE))
+                arm (id);
+        }
+        else if (id >= generations.size () || generations[id] != generation
+                || FREE == handles[id].state)
+            continue;
+        else if (cqe.res < 0)
+            events = ECANCELED == -cqe.res ? 0 : READ_EVENT|WRITE_EVENT;
+        else {
+            uint32_t const mask = cqe.res;
+            events |= mask & (POLLIN|POLLRDHUP|POLLHUP|POLLERR) ? READ_EVENT : 0;
+            events |= mask & (POLLOUT|POLLHUP|POLLERR) ? WRITE_EVENT : 0;
+            events |= mask & POLLERR ? ERROR_EVENT : 0;
+            if (! (cqe.flags & IORING_CQE_F_MORE))
+                poll_add (id);
+        }
+        ++nevent;
+        handles[id].events |= events;
+        if (WAIT == handles[id].state && (handles[id].ev_mask & handles[id].events)) {
+            handles.erase (id);
+            handles[id].state = READY;
+            handles.insert (READY, id);
+        }
+    }
+    __atomic_store_n (cq_head, head, __ATOMIC_RELEASE);
+    return nevent;
+}
+
+}//namespace http
@@ -3,7 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <map>
+#include <sys/uio.h>
 #include "http.hpp"
 #include "html-builder.hpp"
 
@@ -11,21 +13,31 @@ namespace http {
 
 enum {
     SERVER_PORT = 10080,
-    BACKLOG = 10,
-    MAX_CONNECTIONS = 10,
+    BACKLOG = 511,
+    MAX_CONNECTIONS = 1024,
+    POOL_CHUNK = 64,
+    ACCEPT_BATCH = 64,
     LISTENER_COUNT = 1,
-    TIMEOUT = 60, // seconds
+    TIMEOUT = 60000, // milliseconds
+    HEADER_TIMEOUT = 20000, // milliseconds
+    CHUNK_SIZE = 16384,
 
     MAX_KEEPALIVE_REQUESTS = 5,
     LIMIT_REQUEST_FIELDS = 100,
     LIMIT_REQUEST_FIELD_SIZE = 8190,
+    MAX_BODY = 1048576,
 
     BUFFER_SIZE = 4096,
+    INPUT_BUFFER_LIMIT = 65536,
+    OUTPUT_BATCH_LIMIT = 65536,
+    PIPE_SIZE = 1048576,
 
     READ_EVENT = 1,
     WRITE_EVENT = 2,
     TIMER_EVENT = 4,
+    ERROR_EVENT = 8,
     EDGE_EVENT = 0x8000000,
+    ACCEPT_EVENT = 0x4000000,
     FREE = 0,
     WAIT = 1,
     READY = 2,
@@ -33,6 +45,35 @@ enum {
 
 static inline std::string documentroot () { return "public"; }
 
+struct config_type {
+    int port;
+    int backlog;
+    int workers;
+    std::size_t max_connections;
+    std::size_t pool_chunk;
+    std::size_t accept_batch;
+    int timeout;
+    int header_timeout;
+    std::string mplex;
+    bool interest_once;
+    int busy_poll;
+    int busy_poll_socket;
+    std::vector<int> cpus;
+    std::size_t chunk_size;
+    std::size_t zerocopy;
+    std::string upload_dir;
+    std::size_t upload_sync;
+    std::size_t max_body;
+    std::size_t test_throttle;
+    static config_type& getinstance ();
+    bool parse (int argc, char *argv[]);
+
+private:
+    config_type ();
+    config_type (config_type const&);
+    config_type& operator= (config_type const&);
+};
+
 template <class NODE_T>
 class ring_in_vector {
 public:
@@ -48,6 +89,19 @@ public:
             node.emplace_back (i, (n + i - 1) % n, (i + 1) % n);
     }
 
+    // appends n nodes and links them before j.  a deque never moves
+    // its elements when it grows at the end, so a live node keeps its
+    // address, and any pointer it holds into itself, across a grow.
+    void
+    grow (std::size_t const n, std::size_t const j)
+    {
+        std::size_t const m = node.size ();
+        for (std::size_t i = m; i < m + n; ++i) {
+            node.emplace_back (i, i, i);
+            insert (j, i);
+        }
+    }
+
     bool
     empty (std::size_t i) const
     {
@@ -80,7 +134,83 @@ public:
     std::size_t size () const { return node.size (); }
 
 private:
-    std::vector<NODE_T> node;
+    std::deque<NODE_T> node;
+};
+
+class timer_wheel_type {
+public:
+    enum {
+        ROOT_BITS = 8,
+        NODE_BITS = 6,
+        LEVELS = 4,
+        ROOT_SIZE = 1 << ROOT_BITS,
+        NODE_SIZE = 1 << NODE_BITS,
+        ROOT_MASK = ROOT_SIZE - 1,
+        NODE_MASK = NODE_SIZE - 1,
+        SLOTS = ROOT_SIZE + (LEVELS - 1) * NODE_SIZE,
+        EXPIRED = SLOTS,
+        HEADS = SLOTS + 1,
+    };
+    timer_wheel_type ();
+    void resize (std::size_t const n);
+    void reset (int64_t const tick);
+    void insert (std::size_t const id, int64_t const expires);
+    void erase (std::size_t const id);
+    bool linked (std::size_t const id) const;
+    void advance (int64_t const tick);
+    bool expired_empty () const { return next[EXPIRED] == EXPIRED; }
+    std::size_t pop_expired ();
+    int64_t next_expiry () const;
+    int64_t now () const { return current; }
+    // links and expiry kept for each timer id.
+    static std::size_t node_bytes ()
+    {
+        return sizeof (decltype (prev)::value_type) + sizeof (decltype (next)::value_type)
+            + sizeof (decltype (expires)::value_type);
+    }
+
+private:
+    enum {WORDS = (SLOTS + 63) / 64, ROOT_WORDS = ROOT_SIZE / 64};
+    int64_t current;
+    std::vector<std::size_t> prev;
+    std::vector<std::size_t> next;
+    std::vector<int64_t> expires;
+    uint64_t occupied[WORDS];
+    mutable int64_t upper_min;
+    mutable bool upper_known;
+
+    bool empty (std::size_t const head) const { return next[head] == head; }
+    void link (std::size_t const head, std::size_t const node);
+    void unlink (std::size_t const node);
+    void place (std::size_t const id);
+    bool cascade (int const level);
+    void step ();
+    int64_t root_expiry () const;
+    int64_t upper_expiry () const;
+    int64_t next_step () const;
+};
+
+class input_buffer_type {
+public:
+    enum {SPILL_SIZE = 16384};
+    input_buffer_type (std::size_t const initial, std::size_t const limit);
+    ssize_t readv (int const fd);
+    char const* data () const { return buf.data () + head; }
+    std::size_t size () const { return tail - head; }
+    bool empty () const { return head == tail; }
+    std::size_t capacity () const { return buf.size (); }
+    void consume (std::size_t const n);
+    void clear ();
+    void shrink ();
+
+private:
+    std::string buf;
+    std::size_t head;
+    std::size_t tail;
+    std::size_t initial_;
+    std::size_t limit_;
+
+    void compact ();
 };
 
 struct handle_type {
@@ -88,7 +218,7 @@ struct handle_type {
     std::size_t prev, next;
     bool ev_permit;
     int fd;
-    std::time_t uptime;
+    int64_t uptime;
     std::size_t handler_id;
     int state;
     uint32_t ev_mask;
@@ -101,15 +231,18 @@ struct handle_type {
 
 class mplex_io_type {
 public:
-    mplex_io_type (std::size_t const n);
+    mplex_io_type (std::size_t const n, std::size_t const chunk, bool const once);
     virtual ~mplex_io_type () {};
     virtual int add (uint32_t const trigger, int const fd, std::size_t const handler_id) = 0;
     virtual int mod (uint32_t const trigger, std::size_t const id) = 0;
     virtual int drop (uint32_t const events, std::size_t const id) = 0;
     virtual int del (std::size_t const id) = 0;
-    virtual int add_timer (std::time_t const uptime, std::size_t const handler_id);
-    virtual int mod_timer (std::time_t const uptime, std::size_t const id);
+    virtual int add_timer (int64_t const uptime, std::size_t const handler_id);
+    virtual int mod_timer (int64_t const uptime, std::size_t const id);
     virtual int stop_timer (std::size_t const id);
+    int wake (uint32_t const events, std::size_t const id);
+    virtual int accept (std::size_t const id);
+    virtual int accept_limit (std::size_t const id, std::size_t const n);
     virtual int wait (int msec) = 0;
     virtual void run_timer ();
     bool empty () { return handles.empty (READY); }
@@ -119,13 +252,32 @@ public:
     int events (std::size_t const id) { return handles[id].events & handles[id].ev_mask; }
     int next (std::size_t const id) { return handles[id].next; }
     int end () { return READY; }
-    std::time_t looptime () const { return looptime_; }
+    int64_t looptime () const { return looptime_; }
+    std::size_t capacity () const { return handles.size (); }
+    uint64_t ctl_calls () const { return ctl_count; }
+    uint64_t mod_calls () const { return mod_count; }
+    uint64_t wait_calls () const { return wait_count; }
+    uint64_t timer_calls () const { return timer_count; }
+    // bookkeeping held for each handle, its timer included.
+    static std::size_t handle_bytes ()
+    {
+        return sizeof (handle_type) + timer_wheel_type::node_bytes ();
+    }
 
 protected:
     int max_events;
-    std::time_t looptime_;
+    bool interest_once;
+    uint64_t ctl_count;
+    uint64_t mod_count;
+    uint64_t wait_count;
+    uint64_t timer_count;
+    std::size_t grow_chunk;
+    int64_t looptime_;
     ring_in_vector<handle_type> handles;
-    std::multimap<std::time_t, int> timers;
+    timer_wheel_type timers;
+
+    void update_looptime ();
+    void expire_timers ();
 
     inline int range_check (std::size_t const id)
     {
@@ -139,11 +291,13 @@ protected:
         }
         return id;
     }
+
+    bool reserve_free ();
 };
 
 class mplex_epoll_type : public mplex_io_type {
 public:
-    mplex_epoll_type (std::size_t const n);
+    mplex_epoll_type (std::size_t const n, std::size_t const chunk, bool const once);
     ~mplex_epoll_type ();
     int add (uint32_t const trigger, int const fd, std::size_t const handler_id);
     int mod (uint32_t const trigger, std::size_t const id);
@@ -153,10 +307,170 @@ public:
 
 private:
     int epoll_fd;
+    int timer_fd;
+    int64_t timer_expiry;
+    int spin_budget;
+    int spin_current;
     struct epoll_event* evset;
+
+    void arm_timer ();
+    int spin (int const msec);
+};
+
+class mplex_uring_type : public mplex_io_type {
+public:
+    mplex_uring_type (std::size_t const n, std::size_t const chunk, bool const once);
+    ~mplex_uring_type ();
+    bool good () const { return ring_fd >= 0; }
+    int add (uint32_t const trigger, int const fd, std::size_t const handler_id);
+    int mod (uint32_t const trigger, std::size_t const id);
+    int drop (uint32_t const events, std::size_t const id);
+    int del (std::size_t const id);
+    int accept (std::size_t const id);
+    int accept_limit (std::size_t const id, std::size_t const n);
+    int wait (int msec);
+    static std::size_t handle_bytes ()
+    {
+        return mplex_io_type::handle_bytes () + sizeof (decltype (generations)::value_type)
+            + sizeof (decltype (triggers)::value_type);
+    }
+
+private:
+    int ring_fd;
+    unsigned sq_entries;
+    void* sq_ring;
+    std::size_t sq_ring_size;
+    void* cq_ring;
+    std::size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    std::size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned sq_pending;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> triggers;
+
+    // a listener's sockets accepted by the kernel, at most limit of
+    // them, and the generation it was added with: accepts of that or a
+    // later generation are its own.
+    struct listener_type {
+        uint32_t since;
+        std::size_t limit;
+        std::deque<int> accepted;
+    };
+    std::map<std::size_t, listener_type> listeners;
+
+    bool setup (unsigned const entries);
+    void teardown ();
+    int enter (unsigned const min_complete, int const msec);
+    struct io_uring_sqe* get_sqe ();
+    void push_sqe ();
+    int poll_add (std::size_t const id);
+    int poll_remove (std::size_t const id);
+    int accept_add (std::size_t const id);
+    int accept_cancel (std::size_t const id);
+    int arm (std::size_t const id);
+    int disarm (std::size_t const id);
 };
 
 class tcpserver_type;
+class connection_type;
+
+class handler_type {
+public:
+    handler_type () {}
+    virtual ~handler_type () {}
+
+    virtual bool process (connection_type& r);
+    virtual bool get (connection_type& r);
+    virtual bool put (connection_type& r);
+    virtual bool post (connection_type& r);
+    virtual bool accept_body (connection_type& r);
+    virtual ssize_t max_body (connection_type& r);
+    virtual void body_begin (connection_type& r);
+    virtual std::size_t body (connection_type& r, char const* p, std::size_t const n);
+    virtual bool splice_body (connection_type& r);
+    virtual void body_pipe (connection_type& r, int const fd, std::size_t const n);
+    virtual int body_wait (connection_type& r);
+    virtual void release (connection_type& r);
+
+    bool not_modified (connection_type& r);
+    bool created (connection_type& r);
+    bool no_content (connection_type& r);
+
+    bool bad_request (connection_type& r);
+    bool not_found (connection_type& r);
+    bool method_not_allowed (connection_type& r);
+    bool request_timeout (connection_type& r);
+    bool length_required (connection_type& r);
+    bool precondition_failed (connection_type& r);
+    bool request_entity_too_large (connection_type& r);
+    bool unsupported_media_type (connection_type& r);
+    bool expectation_failed (connection_type& r);
+    bool internal_server_error (connection_type& r);
+
+    void error_start (connection_type& r, html_builder_type& html, int code);
+    void error_end (connection_type& r, html_builder_type& html);
+};
+
+// with --test-throttle N, takes request bodies at a bounded rate, as a
+// slow consumer would: N octets up front and N more each TICK
+// milliseconds, counted by a timerfd that wakes the connection when it
+// is behind.  the tests use it; otherwise bodies go straight through.
+class handler_test_type : public handler_type {
+public:
+    enum {TICK = 2};
+    handler_test_type () : credit (0), tick_fd (-1) {}
+    ~handler_test_type () {}
+
+    virtual bool get (connection_type& r);
+    virtual bool post (connection_type& r);
+    virtual void body_begin (connection_type& r);
+    virtual std::size_t body (connection_type& r, char const* p, std::size_t const n);
+    virtual int body_wait (connection_type& r);
+    virtual void release (connection_type& r);
+
+private:
+    std::size_t credit;
+    int tick_fd;
+};
+
+class handler_file_type : public handler_type {
+public:
+    handler_file_type ()
+        : upload_fd (-1), upload_error (0), upload_size (0), upload_synced (0),
+          upload_path (), upload_temp () {}
+    ~handler_file_type () {}
+
+    virtual bool get (connection_type& r);
+    virtual bool put (connection_type& r);
+    virtual bool accept_body (connection_type& r);
+    virtual ssize_t max_body (connection_type& r);
+    virtual void body_begin (connection_type& r);
+    virtual std::size_t body (connection_type& r, char const* p, std::size_t const n);
+    virtual bool splice_body (connection_type& r);
+    virtual void body_pipe (connection_type& r, int const fd, std::size_t const n);
+    virtual void release (connection_type& r);
+
+private:
+    int upload_fd;
+    int upload_error;
+    off_t upload_size;
+    off_t upload_synced;
+    std::string upload_path;
+    std::string upload_temp;
+
+    std::string mime_type (std::string const& path) const;
+    void upload_fail (int const e);
+    void upload_advance (std::size_t const n);
+    bool upload_check (connection_type& r);
+};
 
 class connection_type {
 public:
@@ -172,32 +486,63 @@ public:
         : id (a), prev (b), next (c),
           handle_id (-1), state (FREE), remote_addr (),
           response (), request (),
-          kont_ready (false), kont (), rdbuf (BUFFER_SIZE, '\0'), wrbuf (),
-          rdpos (0), rdsize (0), wrpos (0), wrpos1 (0), wrsize (0),
+          kont_ready (false), kont (), rdbuf (BUFFER_SIZE, INPUT_BUFFER_LIMIT), wrbuf (),
+          wrbatch (), wrframe (), wriov (), wriov_pos (0), wrmore (false), wrkont (),
+          rdkont (),
+          wrpos (0), wrsize (0),
+          wrchunk (0), wrchunk_max (0),
+          wrzerocopy (false), zerocopy (0), zc_sent (0), zc_done (0),
           decoder_request_line (), decoder_request_header (),
-          decoder_chunk () {}
+          decoder_chunk (), test_handler (), file_handler (), route (ROUTE_NONE),
+          rdstarted (false), rdexpect (false), rdwait_handle (-1), rdbody (0), rdspan (), rdpipe {-1, -1}, rdpipe_size (0) {}
     ssize_t iotransfer (tcpserver_type& loop);
     int on_accept (tcpserver_type& loop);
     int on_read (tcpserver_type& loop);
     int on_write (tcpserver_type& loop);
+    int on_error (tcpserver_type& loop);
     int on_timer (tcpserver_type& loop);
     void on_close (tcpserver_type& loop);
+    void rearm_timer (tcpserver_type& loop);
     void clear ();
 
 private:
+    enum {ROUTE_NONE, ROUTE_FILE, ROUTE_TEST};
+    connection_type (connection_type const&);
+    connection_type& operator= (connection_type const&);
+
     typedef void (connection_type::*kont_type) (tcpserver_type& loop);
     bool kont_ready;
     kont_type kont;
-    std::string rdbuf;
+    input_buffer_type rdbuf;
     std::string wrbuf;
-    ssize_t rdpos;
-    ssize_t rdsize;
+    std::string wrbatch;
+    std::string wrframe;
+    std::vector<struct iovec> wriov;
+    std::size_t wriov_pos;
+    bool wrmore;
+    kont_type wrkont;
+    kont_type rdkont;
     ssize_t wrpos;
-    ssize_t wrpos1;
     ssize_t wrsize;
+    ssize_t wrchunk;
+    ssize_t wrchunk_max;
+    bool wrzerocopy;
+    int zerocopy;
+    uint32_t zc_sent;
+    uint32_t zc_done;
     decoder_request_line_type decoder_request_line;
     decoder_request_header_type decoder_request_header;
     decoder_chunk_type decoder_chunk;
+    handler_test_type test_handler;
+    handler_file_type file_handler;
+    int route;
+    bool rdstarted;
+    bool rdexpect;
+    ssize_t rdwait_handle;
+    ssize_t rdbody;
+    std::string rdspan;
+    int rdpipe[2];
+    std::size_t rdpipe_size;
     uint32_t iowait_mask;
     ssize_t ioresult;
     int keepalive_requests;
@@ -206,19 +551,22 @@ private:
     void kont_request_header (tcpserver_type& loop);
     void kont_request_chunked (tcpserver_type& loop);
     void kont_request_length (tcpserver_type& loop);
+    void kont_request_splice (tcpserver_type& loop);
+    void kont_request_resume (tcpserver_type& loop);
     void kont_request_line_read (tcpserver_type& loop);
     void kont_request_header_read (tcpserver_type& loop);
     void kont_request_chunked_read (tcpserver_type& loop);
     void kont_request_length_read (tcpserver_type& loop);
     void kont_dispatch (tcpserver_type& loop);
     void kont_response (tcpserver_type& loop);
-    void kont_response_header (tcpserver_type& loop);
-    void kont_response_chunk_header (tcpserver_type& loop);
+    void kont_response_gather (tcpserver_type& loop);
     void kont_response_chunk_body (tcpserver_type& loop);
-    void kont_response_chunk_crlf (tcpserver_type& loop);
     void kont_response_file_length (tcpserver_type& loop);
-    void kont_response_body_length (tcpserver_type& loop);
+    void kont_response_flushed (tcpserver_type& loop);
+    void kont_response_zerocopy (tcpserver_type& loop);
+    void kont_response_zerocopy_wait (tcpserver_type& loop);
     void kont_response_end (tcpserver_type& loop);
+    void kont_response_close (tcpserver_type& loop);
     void kont_teardown (tcpserver_type& loop);
 
     void ioready ();
@@ -229,83 +577,89 @@ private:
     void prepare_request_chunked ();
     void finalize_request_chunked ();
     void prepare_request_length ();
+    bool prepare_request_expect ();
+    bool request_body_accepted (bool const pending);
+    void request_body_refuse ();
+    void select_handler ();
+    handler_type& handler ();
+    void release_handler ();
+    bool prepare_request_pipe ();
+    bool request_body_flush ();
+    void request_body_stall (tcpserver_type& loop, kont_type const kontinuation);
     void read_with_kontinuation (tcpserver_type& loop, kont_type kontinuation);
     void prepare_response ();
     void decide_transfer_encoding ();
     void prepare_response_body ();
+    void prepare_response_chunks ();
+    void prepare_response_chunk ();
+    void start_chunks (tcpserver_type& loop);
+    void wrqueue_clear ();
+    void wrqueue_push (char const* p, std::size_t const n);
+    void wrqueue_flush (int const sock);
+    void wrqueue_kontinue (bool const more, kont_type const kontinuation);
+    bool wrqueue_batch ();
+    void prepare_zerocopy (tcpserver_type& loop);
+    ssize_t zerocopy_reap (int const sock);
+    void wrbatch_flush (kont_type const kontinuation);
     bool finalize_response ();
     bool done_connection ();
 };
 
-class handler_type {
-public:
-    handler_type () {}
-    virtual ~handler_type () {}
-
-    virtual bool process (connection_type& r);
-    virtual bool get (connection_type& r);
-    virtual bool put (connection_type& r);
-    virtual bool post (connection_type& r);
-
-    bool not_modified (connection_type& r);
-
-    bool bad_request (connection_type& r);
-    bool not_found (connection_type& r);
-    bool method_not_allowed (connection_type& r);
-    bool request_timeout (connection_type& r);
-    bool length_required (connection_type& r);
-    bool precondition_failed (connection_type& r);
-    bool request_entity_too_large (connection_type& r);
-    bool unsupported_media_type (connection_type& r);
-
-    void error_start (connection_type& r, html_builder_type& html, int code);
-    void error_end (connection_type& r, html_builder_type& html);
-};
-
-class handler_test_type : public handler_type {
-public:
-    handler_test_type () {}
-    ~handler_test_type () {}
-
-    virtual bool get (connection_type& r);
-    virtual bool post (connection_type& r);
-};
-
-class handler_file_type : public handler_type {
-public:
-    handler_file_type () {}
-    ~handler_file_type () {}
-
-    virtual bool get (connection_type& r);
-
-private:
-    std::string mime_type (std::string const& path) const;
-};
-
 class tcpserver_type {
 public:
     enum {STOP, RUN};
     mplex_io_type& mplex;
-    tcpserver_type (std::size_t n, int to, mplex_io_type& m)
-        :  mplex (m), max_connections (n), timeout_ (to),
-          listen_port (SERVER_PORT), listen_sock (-1), handlers () {}
-    void run (int const port, int const backlog);
+    tcpserver_type (std::size_t n, std::size_t chunk, int to, int hto, mplex_io_type& m)
+        :  mplex (m), max_connections (n), pool_chunk (chunk),
+          accept_batch (config_type::getinstance ().accept_batch),
+          busy_poll_socket (config_type::getinstance ().busy_poll_socket),
+          chunk_size_ (config_type::getinstance ().chunk_size),
+          zerocopy_ (config_type::getinstance ().zerocopy),
+          timeout_ (to), header_timeout_ (hto),
+          listen_port (SERVER_PORT), listen_sock (-1), listen_handle (-1),
+          incoming_cpu (-1), current_handle_ (-1), accept_paused (false),
+          accept_wakeups (0), accepts (0), accept_batch_max (0), requests (0),
+          passes (0), handlers () {}
+    void run (int const port, int const backlog, int const cpu);
     int register_handler (std::size_t const handler_id);
     int remove_handler (std::size_t const handler_id);
     int timeout () const { return timeout_; }
-    std::time_t looptime () const { return mplex.looptime (); }
+    int header_timeout () const { return header_timeout_; }
+    std::size_t chunk_size () const { return chunk_size_; }
+    std::size_t zerocopy () const { return zerocopy_; }
+    int64_t looptime () const { return mplex.looptime (); }
+    int current_handle () const { return current_handle_; }
     int listen_socket_create (int const port, int const backlog);
     int accept_client (std::string& remote_addr);
     int fd_set_nonblock (int fd);
+    void count_request () { ++requests; }
 
 private:
     std::size_t max_connections;
+    std::size_t pool_chunk;
+    std::size_t accept_batch;
+    int busy_poll_socket;
+    std::size_t chunk_size_;
+    std::size_t zerocopy_;
     int timeout_;
+    int header_timeout_;
     int listen_port;
     int listen_sock;
+    int listen_handle;
+    int incoming_cpu;
+    int current_handle_;
+    bool accept_paused;
+    uint64_t accept_wakeups;
+    uint64_t accepts;
+    uint64_t accept_batch_max;
+    uint64_t requests;
+    uint64_t passes;
     ring_in_vector<connection_type> handlers;
 
     int initialize (int const port, int const backlog);
+    bool reserve_free ();
+    void accept_clients ();
+    void report_stats ();
     void shutdown ();
 };
 
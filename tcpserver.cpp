@@ -2,29 +2,34 @@
 #include <cstdlib>
 #include <csignal>
 #include <cerrno>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "server.hpp"
 
 namespace http {
 
 namespace {
-    volatile std::sig_atomic_t g_signal_alrm = 0;
     volatile std::sig_atomic_t g_signal_status = 0;
 }
 
 static void
 signal_handler (int signal)
 {
-    if (SIGALRM == signal)
-        g_signal_alrm = signal;
-    else
-        g_signal_status = signal;
+    g_signal_status = signal;
 }
 
 static void
@@ -37,32 +42,246 @@ set_signal_handler (int const sig, void (*handler)(int), int const flags)
     sigaction (sig, &sa, nullptr);
 }
 
+config_type::config_type ()
+    : port (SERVER_PORT), backlog (BACKLOG), workers (1),
+      max_connections (MAX_CONNECTIONS), pool_chunk (POOL_CHUNK),
+      accept_batch (ACCEPT_BATCH),
+      timeout (TIMEOUT), header_timeout (HEADER_TIMEOUT), mplex ("epoll"),
+      interest_once (false), busy_poll (0), busy_poll_socket (0), cpus (),
+      chunk_size (CHUNK_SIZE), zerocopy (0), upload_dir (),
+      upload_sync (0), max_body (MAX_BODY), test_throttle (0) {}
+
+config_type&
+config_type::getinstance ()
+{
+    static config_type obj;
+    return obj;
+}
+
+static bool
+decode_option_number (char const* s, long const lower, long const upper, long& x)
+{
+    char* e = nullptr;
+    errno = 0;
+    x = std::strtol (s, &e, 10);
+    return 0 == errno && e != s && '\0' == *e && lower <= x && x <= upper;
+}
+
+// cpu-list = cpu-range *("," cpu-range)
+// cpu-range = number ["-" number]
+static bool
+decode_cpu_list (char const* s, std::vector<int>& cpus)
+{
+    std::vector<int> v;
+    while (s != nullptr) {
+        char* e = nullptr;
+        errno = 0;
+        long lower = std::strtol (s, &e, 10);
+        long upper = lower;
+        if (0 != errno || e == s)
+            return false;
+        if ('-' == *e) {
+            s = e + 1;
+            upper = std::strtol (s, &e, 10);
+            if (0 != errno || e == s)
+                return false;
+        }
+        if (lower < 0 || upper < lower || upper >= CPU_SETSIZE)
+            return false;
+        for (long cpu = lower; cpu <= upper; ++cpu)
+            v.push_back (cpu);
+        if ('\0' == *e)
+            break;
+        if (',' != *e)
+            return false;
+        s = e + 1;
+    }
+    cpus.swap (v);
+    return ! cpus.empty ();
+}
+
+bool
+config_type::parse (int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string const opt (argv[i]);
+        long x;
+        if (i + 1 >= argc)
+            return false;
+        else if ("--port" == opt && decode_option_number (argv[++i], 1, 65535, x))
+            port = x;
+        else if ("--workers" == opt && decode_option_number (argv[++i], 1, 1024, x))
+            workers = x;
+        else if ("--backlog" == opt && decode_option_number (argv[++i], 1, 65535, x))
+            backlog = x;
+        else if ("--max-connections" == opt
+                && decode_option_number (argv[++i], 1, 10000000, x))
+            max_connections = x;
+        else if ("--pool-chunk" == opt
+                && decode_option_number (argv[++i], 1, 65536, x))
+            pool_chunk = x;
+        else if ("--accept-batch" == opt
+                && decode_option_number (argv[++i], 1, 65536, x))
+            accept_batch = x;
+        else if ("--mplex" == opt)
+            mplex = argv[++i];
+        else if ("--interest" == opt && i + 1 < argc
+                && ("once" == std::string (argv[i + 1])
+                    || "toggle" == std::string (argv[i + 1])))
+            interest_once = "once" == std::string (argv[++i]);
+        else if ("--busy-poll" == opt
+                && decode_option_number (argv[++i], 0, 1000000, x))
+            busy_poll = x;
+        else if ("--busy-poll-socket" == opt
+                && decode_option_number (argv[++i], 0, 1000000, x))
+            busy_poll_socket = x;
+        else if ("--chunk-size" == opt
+                && decode_option_number (argv[++i], 256, 16777216, x))
+            chunk_size = x;
+        else if ("--zerocopy" == opt
+                && decode_option_number (argv[++i], 0, 1073741824, x))
+            zerocopy = x;
+        else if ("--upload-dir" == opt)
+            upload_dir = argv[++i];
+        else if ("--upload-sync" == opt
+                && decode_option_number (argv[++i], 0, 1073741824, x))
+            upload_sync = x;
+        else if ("--max-body" == opt
+                && decode_option_number (argv[++i], 0, 1073741824, x))
+            max_body = x;
+        else if ("--test-throttle" == opt
+                && decode_option_number (argv[++i], 0, 1073741824, x))
+            test_throttle = x;
+        else if ("--cpus" == opt && decode_cpu_list (argv[++i], cpus))
+            ;
+        else if ("--timeout" == opt
+                && decode_option_number (argv[++i], 1, 86400000, x))
+            timeout = x;
+        else if ("--header-timeout" == opt
+                && decode_option_number (argv[++i], 1, 86400000, x))
+            header_timeout = x;
+        else
+            return false;
+    }
+    return "epoll" == mplex || "uring" == mplex;
+}
+
+static void
+run_server (config_type const& cfg, std::size_t const chunk, int const cpu,
+    mplex_io_type& mplex)
+{
+    tcpserver_type server (cfg.max_connections, chunk,
+        cfg.timeout, cfg.header_timeout, mplex);
+    server.run (cfg.port, cfg.backlog, cpu);
+}
+
+static int
+pin_worker (config_type const& cfg, int const index)
+{
+    logger_type& log = logger_type::getinstance ();
+    if (cfg.cpus.empty ())
+        return -1;
+    int const cpu = cfg.cpus[index % cfg.cpus.size ()];
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (cpu, &set);
+    int const r = pthread_setaffinity_np (pthread_self (), sizeof set, &set);
+    if (0 != r) {
+        errno = r;
+        log.put_error ("pthread_setaffinity_np cpu " + std::to_string (cpu));
+        return -1;
+    }
+    log.put_info ("worker " + std::to_string (index)
+        + " on cpu " + std::to_string (cpu));
+    return cpu;
+}
+
+// the worker pins itself before it builds the multiplexer, the
+// connection pool and their buffers, so that first touch places
+// them on the memory node of its cpu.
+static void
+run_worker (config_type const& cfg, int const index)
+{
+    int const cpu = pin_worker (cfg, index);
+    std::size_t const chunk = std::min (cfg.pool_chunk, cfg.max_connections);
+    if ("uring" == cfg.mplex) {
+        mplex_uring_type mplex (LISTENER_COUNT + chunk, chunk, cfg.interest_once);
+        if (mplex.good ())
+            return run_server (cfg, chunk, cpu, mplex);
+        logger_type::getinstance ().put_error ("io_uring, falling back to epoll");
+    }
+    mplex_epoll_type mplex (LISTENER_COUNT + chunk, chunk, cfg.interest_once);
+    run_server (cfg, chunk, cpu, mplex);
+}
+
 static void
-start_interval_timer (long const sec, long const usec)
+raise_nofile_limit (config_type const& cfg)
 {
     logger_type& log = logger_type::getinstance ();
-    struct itimerval timer;
-    timer.it_interval.tv_sec = sec;
-    timer.it_interval.tv_usec = usec;
-    timer.it_value.tv_sec = sec;
-    timer.it_value.tv_usec = usec;
-    if (setitimer (ITIMER_REAL, &timer, nullptr) < 0) {
-        log.put_error ("setitimer");
-        exit (EXIT_FAILURE);
+    struct rlimit rl;
+    if (getrlimit (RLIMIT_NOFILE, &rl) < 0)
+        return;
+    // a uring listener may hold up to a backlog of accepted sockets.
+    std::size_t const queued = "uring" == cfg.mplex ? cfg.backlog : 0;
+    rlim_t want = cfg.workers * (cfg.max_connections + LISTENER_COUNT + queued) + 64;
+    if (rl.rlim_cur < want && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = std::min (want, rl.rlim_max);
+        if (setrlimit (RLIMIT_NOFILE, &rl) < 0)
+            log.put_error ("setrlimit RLIMIT_NOFILE");
     }
+    if (rl.rlim_cur < want)
+        log.put_info ("open files limit " + std::to_string (rl.rlim_cur)
+            + " is lower than " + std::to_string (want));
+}
+
+static void
+report_memory (config_type const& cfg)
+{
+    logger_type& log = logger_type::getinstance ();
+    std::size_t const conn = sizeof (connection_type);
+    std::size_t const handlers = sizeof (handler_test_type) + sizeof (handler_file_type);
+    std::size_t const handle = "uring" == cfg.mplex
+        ? mplex_uring_type::handle_bytes () : mplex_epoll_type::handle_bytes ();
+    std::size_t const total = conn + handle + BUFFER_SIZE;
+    log.put_info ("memory per connection " + std::to_string (total)
+        + " bytes (connection " + std::to_string (conn)
+        + " with handlers " + std::to_string (handlers)
+        + ", handle and timer " + std::to_string (handle)
+        + ", read buffer " + std::to_string (BUFFER_SIZE)
+        + "), pool chunk " + std::to_string (cfg.pool_chunk)
+        + ", max connections " + std::to_string (cfg.max_connections));
 }
 
 int
 main_loop (int argc, char *argv[])
 {
     std::setlocale (LC_ALL, "C");
+    config_type& cfg = config_type::getinstance ();
+    if (! cfg.parse (argc, argv)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--port PORT] [--workers N] [--backlog N]"
+                     " [--max-connections N] [--pool-chunk N] [--accept-batch N]"
+                     " [--timeout MSEC] [--header-timeout MSEC]"
+                     " [--mplex epoll|uring] [--interest once|toggle]"
+                     " [--busy-poll USEC] [--busy-poll-socket USEC]"
+                     " [--cpus LIST] [--chunk-size N] [--zerocopy BYTES]"
+                     " [--upload-dir DIR] [--upload-sync BYTES] [--max-body BYTES]"
+                     " [--test-throttle N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    raise_nofile_limit (cfg);
+    report_memory (cfg);
     std::signal (SIGPIPE, SIG_IGN);
     set_signal_handler (SIGINT, signal_handler, 0);
-    set_signal_handler (SIGALRM, signal_handler, SA_RESTART);
-    start_interval_timer (1L, 0);
-    mplex_epoll_type mplex (LISTENER_COUNT + MAX_CONNECTIONS);
-    tcpserver_type server (MAX_CONNECTIONS, TIMEOUT, mplex);
-    server.run (SERVER_PORT, BACKLOG);
+    if (1 == cfg.workers) {
+        run_worker (cfg, 0);
+        return EXIT_SUCCESS;
+    }
+    std::vector<std::thread> workers;
+    for (int i = 0; i < cfg.workers; ++i)
+        workers.emplace_back (run_worker, std::ref (cfg), i);
+    for (auto& x : workers)
+        x.join ();
     return EXIT_SUCCESS;
 }
 
@@ -82,9 +301,10 @@ tcpserver_type::initialize (int const port, int const backlog)
         ;
     else if (fd_set_nonblock (listen_sock) < 0)
         log.put_error ("fd_set_nonblock (listen_fd)");
-    else if (mplex.add (READ_EVENT, listen_sock, 0) < 0)
+    else if ((listen_handle = mplex.add (READ_EVENT|ACCEPT_EVENT, listen_sock, 0)) < 0)
         ;
     else {
+        mplex.accept_limit (listen_handle, backlog);
         log.put_info ("listening port " + std::to_string (port));
         return RUN;
     }
@@ -96,18 +316,16 @@ tcpserver_type::initialize (int const port, int const backlog)
 }
 
 void
-tcpserver_type::run (int const port, int const backlog)
+tcpserver_type::run (int const port, int const backlog, int const cpu)
 {
     logger_type& log = logger_type::getinstance ();
-    handlers.resize (1 + max_connections);
+    incoming_cpu = cpu;
+    handlers.resize (WAIT + 1);
     handlers.erase (WAIT);
     int kont = initialize (port, backlog);
     while (RUN == kont) {
-        if (g_signal_alrm) {
-            mplex.run_timer ();
-            g_signal_alrm = 0;
-        }
-        else if (mplex.wait (1000) < 0) {
+        // bounded so that sibling workers notice SIGINT.
+        if (mplex.wait (1000) < 0) {
             log.put_error ("mplex.wait");
             break;
         }
@@ -115,6 +333,7 @@ tcpserver_type::run (int const port, int const backlog)
             break;
         if (mplex.empty ())
             continue;
+        ++passes;
         std::size_t next_i = mplex.end ();
         for (std::size_t i = mplex.begin (); i != mplex.end (); i = next_i) {
             if (g_signal_status)
@@ -122,6 +341,7 @@ tcpserver_type::run (int const port, int const backlog)
             next_i = mplex.next (i);
             uint32_t events = mplex.events (i);
             int handler_id = mplex.handler_id (i);
+            current_handle_ = i;
             if (events & TIMER_EVENT) {
                 mplex.stop_timer (i);
                 handlers[handler_id].on_timer (*this);
@@ -132,17 +352,76 @@ tcpserver_type::run (int const port, int const backlog)
             else if (events & WRITE_EVENT) {
                 handlers[handler_id].on_write (*this);
             }
+            else if (events & ERROR_EVENT) {
+                handlers[handler_id].on_error (*this);
+            }
             else if ((events & READ_EVENT) && 0 == handler_id) {
-                if (! handlers.empty (FREE)) {
-                    int fresh_handler_id = handlers[FREE].next;
-                    handlers[fresh_handler_id].on_accept (*this);
-                }
+                accept_clients ();
             }
         }
     }
     shutdown ();
 }
 
+bool
+tcpserver_type::reserve_free ()
+{
+    if (! handlers.empty (FREE))
+        return true;
+    std::size_t const n = handlers.size () - (WAIT + 1);
+    if (n >= max_connections)
+        return false;
+    handlers.grow (std::min (pool_chunk, max_connections - n), FREE);
+    return true;
+}
+
+// drains up to accept_batch pending clients per wakeup.  the listener
+// waits again only once accept has said EAGAIN, since io_uring does not
+// report it again while clients remain as level-triggered epoll does: a
+// full batch leaves it ready for the next pass, and a full pool parks it
+// with no read interest until a connection closes.
+void
+tcpserver_type::accept_clients ()
+{
+    std::size_t count = 0;
+    while (count < accept_batch) {
+        if (! reserve_free ()) {
+            accept_paused = true;
+            break;
+        }
+        std::size_t const fresh_handler_id = handlers[FREE].next;
+        if (FREE == handlers[fresh_handler_id].on_accept (*this))
+            break;
+        ++count;
+    }
+    if (accept_paused)
+        mplex.mod (ERROR_EVENT, listen_handle);
+    else if (count < accept_batch)
+        mplex.drop (READ_EVENT, listen_handle);
+    ++accept_wakeups;
+    accepts += count;
+    accept_batch_max = std::max<uint64_t> (accept_batch_max, count);
+}
+
+void
+tcpserver_type::report_stats ()
+{
+    logger_type& log = logger_type::getinstance ();
+    log.put_info ("accepts " + std::to_string (accepts)
+        + " in " + std::to_string (accept_wakeups) + " wakeups"
+        + ", max batch " + std::to_string (accept_batch_max));
+    log.put_info ("mplex ctl " + std::to_string (mplex.ctl_calls ())
+        + ", wait " + std::to_string (mplex.wait_calls ())
+        + ", timer " + std::to_string (mplex.timer_calls ())
+        + ", passes " + std::to_string (passes));
+    uint64_t const per_mille = requests > 0 ? mplex.mod_calls () * 1000 / requests : 0;
+    log.put_info ("requests " + std::to_string (requests)
+        + ", interest changes " + std::to_string (mplex.mod_calls ())
+        + " (" + std::to_string (per_mille / 1000) + "."
+        + std::to_string (per_mille / 100 % 10) + std::to_string (per_mille / 10 % 10)
+        + std::to_string (per_mille % 10) + " per request)");
+}
+
 int
 tcpserver_type::register_handler (std::size_t handler_id)
 {
@@ -162,6 +441,11 @@ tcpserver_type::remove_handler (std::size_t handler_id)
         handlers[handler_id].state = FREE;
         handlers.erase (handler_id);
         handlers.insert (handlers[handler_id].state, handler_id);
+        if (accept_paused) {
+            accept_paused = false;
+            mplex.mod (READ_EVENT|ACCEPT_EVENT, listen_handle);
+            mplex.wake (READ_EVENT, listen_handle);
+        }
     }
     return FREE;
 }
@@ -171,6 +455,7 @@ tcpserver_type::shutdown ()
 {
     logger_type& log = logger_type::getinstance ();
     log.put_info ("shutdown");
+    report_stats ();
     for (std::size_t i = 0; i < handlers.size (); ++i) {
         if (handlers[i].id > 0 && FREE != handlers[i].state)
             handlers[i].on_close (*this);
@@ -190,11 +475,21 @@ tcpserver_type::listen_socket_create (int const port, int const backlog)
     addr.sin_addr.s_addr = htonl (INADDR_ANY);
     addr.sin_port = htons (port);
     int yes = 1;
+    bool const reuseport = config_type::getinstance ().workers > 1;
     int const sock = socket (PF_INET, SOCK_STREAM, 0);
     if (sock < 0)
         log.put_error ("socket");
     else if (setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes) < 0)
         log.put_error ("setsockopt");
+    else if (reuseport
+            && setsockopt (sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes) < 0)
+        log.put_error ("setsockopt SO_REUSEPORT");
+    // among the reuseport group, prefer the listener whose worker runs
+    // on the cpu that received the flow.
+    else if (reuseport && incoming_cpu >= 0
+            && setsockopt (sock, SOL_SOCKET, SO_INCOMING_CPU,
+                &incoming_cpu, sizeof incoming_cpu) < 0)
+        log.put_error ("setsockopt SO_INCOMING_CPU");
     else if (bind (sock, sockaddr_ptr (addr), sizeof addr) < 0)
         log.put_error ("bind");
     else if (listen (sock, backlog) < 0)
@@ -210,16 +505,33 @@ int
 tcpserver_type::accept_client (std::string& remote_addr)
 {
     logger_type& log = logger_type::getinstance ();
-    struct sockaddr_in addr;
+    struct sockaddr_in addr = {0};
     socklen_t len = sizeof addr;
-    int const conn_sock = accept (listen_sock, sockaddr_ptr (addr), &len);
+    // with multishot accept the ring has accepted already; the peer
+    // address is then a getpeername away.
+    int conn_sock = mplex.accept (listen_handle);
+    if (conn_sock >= 0)
+        getpeername (conn_sock, sockaddr_ptr (addr), &len);
+    else if (ENOSYS == errno)
+        conn_sock = accept4 (listen_sock, sockaddr_ptr (addr), &len,
+            SOCK_NONBLOCK|SOCK_CLOEXEC);
     int const e = errno;
     if (conn_sock < 0 && (EINTR == e || EAGAIN == e || EWOULDBLOCK == e))
         ;
     else if (conn_sock < 0)
         log.put_error ("accept");
-    else
+    else {
+        // responses are coalesced with MSG_MORE, so Nagle only adds a
+        // delayed-ack stall between the header and a short body.
+        int const one = 1;
+        setsockopt (conn_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        // raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN;
+        // without it the socket keeps the system default.
+        if (busy_poll_socket > 0)
+            setsockopt (conn_sock, SOL_SOCKET, SO_BUSY_POLL,
+                &busy_poll_socket, sizeof busy_poll_socket);
         remote_addr = inet_ntoa (addr.sin_addr);
+    }
     return conn_sock;
 }
 
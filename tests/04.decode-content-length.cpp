@@ -65,9 +65,9 @@ void
 test_7 (test::simple& ts)
 {
     std::string input = "2147483648";
-    http::content_length_type expected = {413, 0};
+    http::content_length_type expected = {200, 2147483648L};
     http::content_length_type got;
-    ts.ok (! http::decode (got, input), input + " decode");
+    ts.ok (http::decode (got, input), input + " decode");
     ts.ok (got == expected, input + " got");
 }
 
@@ -111,10 +111,50 @@ test_11 (test::simple& ts)
     ts.ok (got == expected, input + " got");
 }
 
+void
+test_12 (test::simple& ts)
+{
+    std::string input = "4294967312";
+    http::content_length_type expected = {200, 4294967312L};
+    http::content_length_type got;
+    ts.ok (http::decode (got, input), input + " decode");
+    ts.ok (got == expected, input + " got");
+}
+
+void
+test_13 (test::simple& ts)
+{
+    std::string input = "9223372036854775807";
+    http::content_length_type expected = {200, 9223372036854775807L};
+    http::content_length_type got;
+    ts.ok (http::decode (got, input), input + " decode");
+    ts.ok (got == expected, input + " got");
+}
+
+void
+test_14 (test::simple& ts)
+{
+    std::string input = "9223372036854775808";
+    http::content_length_type expected = {413, 0};
+    http::content_length_type got;
+    ts.ok (! http::decode (got, input), input + " decode");
+    ts.ok (got == expected, input + " got");
+}
+
+void
+test_15 (test::simple& ts)
+{
+    std::string input = "92233720368547758070";
+    http::content_length_type expected = {413, 0};
+    http::content_length_type got;
+    ts.ok (! http::decode (got, input), input + " decode");
+    ts.ok (got == expected, input + " got");
+}
+
 int
 main ()
 {
-    test::simple ts (22);
+    test::simple ts (30);
     test_1 (ts);
     test_2 (ts);
     test_3 (ts);
@@ -126,5 +166,9 @@ main ()
     test_9 (ts);
     test_10 (ts);
     test_11 (ts);
+    test_12 (ts);
+    test_13 (ts);
+    test_14 (ts);
+    test_15 (ts);
     return ts.done_testing ();
 }
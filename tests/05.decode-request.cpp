@@ -28,6 +28,8 @@ test_1 (test::simple& ts)
     ts.ok (req.method == "GET", "method GET");
     ts.ok (req.uri == "/example.html", "target-form /example.html");
     ts.ok (req.http_version == "HTTP/1.1", "version HTTP/1.1");
+    ts.ok (req.method_id == http::METHOD_GET && req.version == http::HTTP_1_1,
+        "method and version ids");
     ts.ok (req.header.count ("host") > 0, "Host");
     ts.ok (req.header.at ("host") == "example.net:10080", "Host: example.net:10080");
     ts.ok (req.header.count ("connection") > 0, "Connection");
@@ -56,13 +58,92 @@ test_1 (test::simple& ts)
     ts.ok (req.method == "OPTION", "method OPTION");
     ts.ok (req.uri == "*", "target-form *");
     ts.ok (req.http_version == "HTTP/1.0", "version HTTP/1.0");
+    ts.ok (req.method_id == http::METHOD_OTHER && req.version == http::HTTP_1_0,
+        "method and version ids");
     ts.ok (req.header.size () == 0, "header empty");
 }
 
+void
+test_2 (test::simple& ts)
+{
+    http::header_map_type header;
+    header.add ("accept", "text/html");
+    header.add ("Host", "example.net");
+    header.add ("accept", "text/plain");
+    ts.ok (header.size () == 2, "repeated field joins one entry");
+    ts.ok (header.at ("accept") == "text/html,text/plain", "joined with a comma");
+    ts.ok (header.count ("HOST") == 1 && header.at ("host") == "example.net",
+        "lookup ignores case");
+    header.set ("host", "example.org:8080");
+    header.set ("accept", "*/*");
+    ts.ok (header.at ("host") == "example.org:8080" && header.at ("accept") == "*/*",
+        "set replaces the value");
+    ts.ok (header.count ("cookie") == 0 && header.at ("cookie").empty (),
+        "missing field");
+    http::header_map_type other {{"accept", "*/*"}, {"host", "example.org:8080"}};
+    ts.ok (header == other, "same fields in the same order compare equal");
+    header.add ("Content-Length", "42");
+    header.add ("x-forwarded-for", "192.0.2.1");
+    ts.ok (header.count (http::HEADER_CONTENT_LENGTH) == 1
+            && header.at (http::HEADER_CONTENT_LENGTH) == "42"
+            && header.count (http::HEADER_CONNECTION) == 0,
+        "known fields by id");
+    bool ids = true;
+    for (std::string const name : {"connection", "content-length", "expect", "host",
+            "if-match", "if-modified-since", "if-none-match",
+            "if-unmodified-since", "transfer-encoding"})
+        ids = ids && http::header_id (name.data (), name.size ()) >= 0;
+    for (std::string const name : {"te", "hosts", "accept", "x-forwarded-for",
+            "content-type", "if-range", "Transfer-Encodinh"})
+        ids = ids && http::header_id (name.data (), name.size ()) < 0;
+    ts.ok (ids && http::header_id ("HOST", 4) == http::HEADER_HOST, "header_id");
+    header.clear ();
+    ts.ok (header.empty () && header.count ("accept") == 0
+            && header.count (http::HEADER_CONTENT_LENGTH) == 0, "clear");
+}
+
+// fields go into the map as they are decoded, octet by octet or in
+// spans; both ways must leave the same fields behind.
+void
+test_3 (test::simple& ts)
+{
+    std::string input =
+        "Connection: keep-alive  \r\n"
+        "X-Folded: one  \r\n"
+        "   two \t\r\n"
+        "Host: example.net\r\n"
+        "connection:\tupgrade\r\n"
+        "Content-Length: 42\r\n"
+        "\r\n"
+        ;
+    http::request_type octets;
+    http::request_type spans;
+    http::decoder_request_header_type decoder;
+    for (char c : input)
+        if (! decoder.put (static_cast<uint8_t> (c), octets))
+            break;
+    bool const octets_good = decoder.good ();
+    decoder.clear ();
+    std::size_t const n = decoder.put (input.data (), input.size (), spans);
+    ts.ok (octets_good && decoder.good () && n == input.size (), "decoded both ways");
+    ts.ok (octets.header == spans.header && spans.header.size () == 4, "same fields");
+    ts.ok (spans.header.at ("x-folded") == "one two", "obs-fold joins with one space");
+    ts.ok (spans.header.at (http::HEADER_CONNECTION) == "keep-alive,upgrade"
+            && spans.header.at (http::HEADER_HOST) == "example.net",
+        "repeated known field joined");
+    std::string const& length = spans.header.at (http::HEADER_CONTENT_LENGTH);
+    bool const before = "42" == length;
+    spans.header.set ("content-length", "4096");
+    ts.ok (before && "4096" == spans.header.at (http::HEADER_CONTENT_LENGTH),
+        "known field follows set");
+}
+
 int
 main ()
 {
-    test::simple ts (17);
+    test::simple ts (33);
     test_1 (ts);
+    test_2 (ts);
+    test_3 (ts);
     return ts.done_testing ();
 }
@@ -1,5 +1,8 @@
+#include <string>
+#include <random>
 #include "../http.hpp"
 #include "taptests.hpp"
+#include "decode-fuzz.hpp"
 
 void
 test_1 (test::simple& ts)
@@ -40,10 +43,126 @@ test_1 (test::simple& ts)
     ts.ok (got == expected, "body");
 }
 
+// a chunked body of random chunks, extensions and trailer fields.
+static std::string
+chunked (std::mt19937& rng, std::string& payload)
+{
+    static const char HEX[] = "0123456789abcdef";
+    std::string s;
+    int const nchunk = rng () % 5;
+    for (int k = 0; k < nchunk; ++k) {
+        std::size_t const size = 1 + rng () % (0 == rng () % 4 ? 5000 : 40);
+        std::string hex;
+        for (std::size_t x = size; x > 0; x /= 16)
+            hex.insert (hex.begin (), HEX[x % 16]);
+        s += std::string (rng () % 3, '0') + hex;
+        if (0 == rng () % 4)
+            s += ";name=\"q\\\"v\";x";
+        s += "\r\n";
+        std::string data (size, 'a');
+        for (char& c : data)
+            c = char (rng ());
+        payload += data;
+        s += data + "\r\n";
+    }
+    s += "0\r\n";
+    if (0 == rng () % 3)
+        s += "Trailer-Field: value\r\n";
+    s += "\r\n";
+    return s;
+}
+
+static const std::string NOISE ("0123456789abcdefXx;=\"\\\r\n \t:");
+
+static bool
+same (http::decoder_chunk_type const& x, http::decoder_chunk_type const& y)
+{
+    return x.good () == y.good () && x.bad () == y.bad () && x.partial () == y.partial ()
+        && x.content_length == y.content_length && x.chunk_size == y.chunk_size;
+}
+
+// the bulk put against the octet one on the same input, with the input
+// cut at random places as reads would leave it.
+void
+test_2 (test::simple& ts)
+{
+    std::mt19937 rng (6);
+    int agree = 0, total = 0, good = 0, payload_ok = 0;
+    for (int round = 0; round < 20000; ++round) {
+        std::string payload;
+        std::string const clean = chunked (rng, payload);
+        std::string const s = 0 == rng () % 2 ? clean : test::mutate (rng, clean, NOISE);
+        http::decoder_chunk_type reference;
+        http::decoder_chunk_type bulk;
+        if (0 == rng () % 8)
+            reference.chunk_size_limit = bulk.chunk_size_limit = 1 + rng () % 512;
+        std::string body1, body2;
+        std::size_t n1 = 0;
+        while (n1 < s.size () && reference.partial ())
+            reference.put (static_cast<uint8_t> (s[n1++]), body1);
+        std::size_t const n2 = test::put_spans (s, test::cutpoints (rng, s.size (), 3000),
+            [&] (char const* p, std::size_t const n) { return bulk.put (p, n, body2); },
+            [&] () { return bulk.partial (); });
+        ++total;
+        if (n1 == n2 && body1 == body2 && same (reference, bulk))
+            ++agree;
+        else if (total - agree == 1)
+            ts.diag ("differs on: " + test::printable (s));
+        if (bulk.good ())
+            ++good;
+        if (s == clean && bulk.good () && body2 == payload)
+            ++payload_ok;
+    }
+    ts.ok (agree == total, "bulk put matches octet put on chunked bodies");
+    ts.ok (good > total / 4 && good < total, "the fuzz reaches both verdicts");
+    ts.ok (payload_ok > total / 4, "bulk put recovers the payload");
+    std::string const s = "5\r\nhello\r\n0\r\n\r\nGET / HTTP/1.1\r\n";
+    http::decoder_chunk_type decoder;
+    std::string body;
+    ts.ok (decoder.put (s.data (), s.size (), body) == 15 && decoder.good ()
+        && body == "hello", "stops at the end of the body");
+}
+
+// cycles per byte of a megabyte in 16 KiB chunks through either path.
+void
+test_3 (test::simple& ts)
+{
+    std::string const data (16384, 'x');
+    std::string s;
+    for (int k = 0; k < 64; ++k)
+        s += "4000\r\n" + data + "\r\n";
+    s += "0\r\n\r\n";
+    int const rounds = 8;
+    bool ok = true;
+    std::string body;
+    body.reserve (64 * data.size ());
+    uint64_t t0 = test::ticks ();
+    for (int k = 0; k < rounds; ++k) {
+        http::decoder_chunk_type decoder;
+        body.clear ();
+        for (char c : s)
+            if (! decoder.put (static_cast<uint8_t> (c), body))
+                break;
+        ok = ok && decoder.good () && body.size () == 64 * data.size ();
+    }
+    uint64_t t1 = test::ticks ();
+    for (int k = 0; k < rounds; ++k) {
+        http::decoder_chunk_type decoder;
+        body.clear ();
+        decoder.put (s.data (), s.size (), body);
+        ok = ok && decoder.good () && body.size () == 64 * data.size ();
+    }
+    uint64_t t2 = test::ticks ();
+    ts.diag (test::put_rates (t0, t1, t2, double (rounds) * s.size ()));
+    ts.ok (ok, "both paths decode the benchmark body");
+}
+
 int
 main ()
 {
-    test::simple ts (2);
+    test::simple ts (7);
     test_1 (ts);
+    test_2 (ts);
+    test_3 (ts);
     return ts.done_testing ();
 }
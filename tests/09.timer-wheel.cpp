@@ -0,0 +1,203 @@
+#include <map>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include "../server.hpp"
+#include "taptests.hpp"
+
+typedef std::chrono::steady_clock clock_type;
+
+static double
+elapsed_nsec (clock_type::time_point const t0, std::size_t const n)
+{
+    auto const d = clock_type::now () - t0;
+    return std::chrono::duration<double, std::nano> (d).count () / n;
+}
+
+void
+test_1 (test::simple& ts)
+{
+    std::mt19937 rng (1);
+    std::uniform_int_distribution<int64_t> dist (0, 300000);
+    std::size_t const n = 5000;
+    std::vector<int64_t> expires (n);
+    http::timer_wheel_type wheel;
+    wheel.resize (n);
+    wheel.reset (1000);
+    for (std::size_t i = 0; i < n; ++i) {
+        expires[i] = 1000 + dist (rng);
+        wheel.insert (i, expires[i]);
+    }
+    for (std::size_t i = 0; i < n; i += 7) {
+        wheel.erase (i);
+        expires[i] = -1;
+    }
+    bool early = true;
+    bool late = true;
+    std::size_t fired = 0;
+    for (int64_t tick = 1000; tick < 1000 + 300000 + 97; tick += 97) {
+        wheel.advance (tick);
+        while (! wheel.expired_empty ()) {
+            std::size_t const id = wheel.pop_expired ();
+            early = early && expires[id] >= 0 && expires[id] <= tick;
+            late = late && expires[id] > tick - 97;
+            expires[id] = -1;
+            ++fired;
+        }
+    }
+    ts.ok (early, "no timer fires before its tick");
+    ts.ok (late, "every timer fires in the advance covering its tick");
+    ts.ok (fired == n - (n + 6) / 7, "erased timers never fire");
+}
+
+void
+test_2 (test::simple& ts)
+{
+    http::timer_wheel_type wheel;
+    wheel.resize (4);
+    wheel.reset (10);
+    ts.ok (wheel.next_expiry () == std::numeric_limits<int64_t>::max (),
+        "empty wheel has no expiry");
+    wheel.insert (0, 20);
+    ts.ok (wheel.next_expiry () == 20, "next_expiry root slot");
+    wheel.insert (0, 10 + 100000);
+    ts.ok (wheel.next_expiry () == 10 + 100000, "next_expiry upper level");
+    wheel.insert (1, 15);
+    wheel.insert (1, 30);
+    wheel.advance (29);
+    ts.ok (wheel.expired_empty (), "rearmed timer does not fire at old tick");
+    wheel.advance (30);
+    ts.ok (! wheel.expired_empty () && 1 == wheel.pop_expired (), "rearmed timer fires");
+    wheel.advance (10 + 100000);
+    ts.ok (! wheel.expired_empty () && 0 == wheel.pop_expired (), "far timer fires");
+}
+
+// drives the wheel as the timerfd does, waking it only at next_expiry ():
+// that must be the earliest live deadline, and the wake must fire all
+// of the timers due then and no others.
+void
+test_3 (test::simple& ts)
+{
+    std::mt19937 rng (3);
+    std::size_t const n = 2000;
+    int64_t const never = std::numeric_limits<int64_t>::max ();
+    std::vector<int64_t> expires (n, -1);
+    http::timer_wheel_type wheel;
+    wheel.resize (n);
+    wheel.reset (0);
+    bool exact = true;
+    bool due = true;
+    for (int round = 0; round < 20000; ++round) {
+        std::size_t const id = rng () % n;
+        int64_t const now = wheel.now ();
+        if (0 == rng () % 5) {
+            wheel.erase (id);
+            expires[id] = -1;
+        }
+        else {
+            expires[id] = now + 1 + rng () % (0 == rng () % 8 ? 10000000 : 60000);
+            wheel.insert (id, expires[id]);
+        }
+        if (0 != rng () % 4)
+            continue;
+        int64_t earliest = never;
+        for (int64_t const x : expires)
+            if (x >= 0)
+                earliest = std::min (earliest, x);
+        int64_t const next = wheel.next_expiry ();
+        exact = exact && next == earliest;
+        if (never == next)
+            continue;
+        wheel.advance (next);
+        while (! wheel.expired_empty ()) {
+            std::size_t const k = wheel.pop_expired ();
+            due = due && expires[k] == next;
+            expires[k] = -1;
+        }
+        for (int64_t const x : expires)
+            due = due && x != next;
+    }
+    ts.ok (exact, "next_expiry is the earliest deadline");
+    ts.ok (due, "a wake at next_expiry fires the timers due then");
+}
+
+// compares with the std::multimap<std::time_t, int> timer set
+// mplex_io_type used before: insert, rearm by lower_bound scan plus
+// erase and insert, then expire everything.
+void
+bench_1 (test::simple& ts, std::size_t const n)
+{
+    int64_t const timeout = 60000;
+    std::mt19937 rng (n);
+    std::uniform_int_distribution<int64_t> dist (0, timeout);
+    std::vector<int64_t> uptime (n);
+    for (auto& x : uptime)
+        x = dist (rng);
+
+    std::multimap<int64_t, std::size_t> timers;
+    auto t0 = clock_type::now ();
+    for (std::size_t id = 0; id < n; ++id)
+        timers.emplace (uptime[id], id);
+    double const mm_insert = elapsed_nsec (t0, n);
+    t0 = clock_type::now ();
+    for (std::size_t id = 0; id < n; ++id) {
+        for (auto i = timers.lower_bound (uptime[id]); i != timers.end (); ++i)
+            if (i->second == id) {
+                timers.erase (i);
+                break;
+            }
+        timers.emplace (uptime[id] + timeout, id);
+    }
+    double const mm_rearm = elapsed_nsec (t0, n);
+    t0 = clock_type::now ();
+    std::size_t mm_fired = 0;
+    for (auto i = timers.begin (); i != timers.end ();) {
+        ++mm_fired;
+        i = timers.erase (i);
+    }
+    double const mm_expire = elapsed_nsec (t0, n);
+
+    http::timer_wheel_type wheel;
+    wheel.resize (n);
+    wheel.reset (0);
+    t0 = clock_type::now ();
+    for (std::size_t id = 0; id < n; ++id)
+        wheel.insert (id, uptime[id]);
+    double const tw_insert = elapsed_nsec (t0, n);
+    t0 = clock_type::now ();
+    for (std::size_t id = 0; id < n; ++id)
+        wheel.insert (id, uptime[id] + timeout);
+    double const tw_rearm = elapsed_nsec (t0, n);
+    t0 = clock_type::now ();
+    wheel.advance (2 * timeout);
+    std::size_t tw_fired = 0;
+    while (! wheel.expired_empty ()) {
+        wheel.pop_expired ();
+        ++tw_fired;
+    }
+    double const tw_expire = elapsed_nsec (t0, n);
+
+    ts.diag (std::to_string (n) + " timers ns/op insert rearm expire:"
+        + " multimap " + std::to_string (mm_insert)
+        + " " + std::to_string (mm_rearm)
+        + " " + std::to_string (mm_expire)
+        + " wheel " + std::to_string (tw_insert)
+        + " " + std::to_string (tw_rearm)
+        + " " + std::to_string (tw_expire));
+    ts.ok (mm_fired == n && tw_fired == n, std::to_string (n) + " timers expired");
+}
+
+int
+main ()
+{
+    test::simple ts (14);
+    test_1 (ts);
+    test_2 (ts);
+    test_3 (ts);
+    bench_1 (ts, 10000);
+    bench_1 (ts, 100000);
+    bench_1 (ts, 1000000);
+    return ts.done_testing ();
+}
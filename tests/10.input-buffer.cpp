@@ -0,0 +1,81 @@
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../server.hpp"
+#include "taptests.hpp"
+
+static void
+send_all (int const fd, std::string const& s)
+{
+    std::size_t pos = 0;
+    while (pos < s.size ()) {
+        ssize_t const n = write (fd, s.data () + pos, s.size () - pos);
+        if (n <= 0)
+            break;
+        pos += n;
+    }
+}
+
+static std::string
+pattern (std::size_t const n)
+{
+    std::string s;
+    for (std::size_t i = 0; i < n; ++i)
+        s.push_back ('a' + i % 26);
+    return s;
+}
+
+void
+test_1 (test::simple& ts)
+{
+    int sv[2];
+    socketpair (AF_UNIX, SOCK_STREAM, 0, sv);
+    http::input_buffer_type buf (64, 1024);
+    std::string const s = pattern (40);
+    send_all (sv[0], s);
+    ts.ok (buf.readv (sv[1]) == 40, "read into the free tail");
+    ts.ok (std::string (buf.data (), buf.size ()) == s, "span holds the octets");
+    buf.consume (30);
+    ts.ok (buf.size () == 10 && std::string (buf.data (), 10) == s.substr (30),
+        "consume advances the span");
+    std::string const t = pattern (50);
+    send_all (sv[0], t);
+    ts.ok (buf.readv (sv[1]) == 50, "read after compaction");
+    ts.ok (buf.capacity () == 64
+        && std::string (buf.data (), buf.size ()) == s.substr (30) + t,
+        "compaction keeps the span contiguous");
+    close (sv[0]);
+    close (sv[1]);
+}
+
+void
+test_2 (test::simple& ts)
+{
+    int sv[2];
+    socketpair (AF_UNIX, SOCK_STREAM, 0, sv);
+    http::input_buffer_type buf (64, 1024);
+    std::string const s = pattern (900);
+    send_all (sv[0], s);
+    ts.ok (buf.readv (sv[1]) == 900, "burst beyond the buffer in one readv");
+    ts.ok (buf.capacity () >= 900 && buf.capacity () <= 1024, "buffer grows up to the limit");
+    ts.ok (std::string (buf.data (), buf.size ()) == s, "spilled octets follow in order");
+    send_all (sv[0], pattern (500));
+    ts.ok (buf.readv (sv[1]) == 124, "read stops at the limit");
+    errno = 0;
+    ts.ok (buf.readv (sv[1]) < 0 && ENOBUFS == errno, "full buffer refuses to read");
+    buf.consume (buf.size ());
+    buf.shrink ();
+    ts.ok (buf.empty () && buf.capacity () == 64, "idle buffer shrinks back");
+    close (sv[0]);
+    close (sv[1]);
+}
+
+int
+main ()
+{
+    test::simple ts (11);
+    test_1 (ts);
+    test_2 (ts);
+    return ts.done_testing ();
+}
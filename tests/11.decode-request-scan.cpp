@@ -0,0 +1,205 @@
+#include <string>
+#include <random>
+#include "../http.hpp"
+#include "../decode-scan.hpp"
+#include "taptests.hpp"
+#include "decode-fuzz.hpp"
+
+struct decoder_type {
+    http::request_type req;
+    http::decoder_request_line_type line;
+    http::decoder_request_header_type header;
+    decoder_type (std::size_t const limit)
+        : req (), line (), header ()
+    {
+        line.set_limit_nbyte (limit);
+        header.set_limit_nbyte (limit);
+    }
+    bool partial () const
+    {
+        return line.partial () || (line.good () && header.partial ());
+    }
+    void clear ()
+    {
+        req.clear ();
+        line.clear ();
+        header.clear ();
+    }
+    bool operator == (decoder_type const& x) const
+    {
+        return line.good () == x.line.good () && line.bad () == x.line.bad ()
+            && header.good () == x.header.good () && header.bad () == x.header.bad ()
+            && req.method == x.req.method && req.uri == x.req.uri
+            && req.http_version == x.req.http_version && req.header == x.req.header
+            && req.method_id == x.req.method_id && req.version == x.req.version;
+    }
+};
+
+// the reference: one octet at a time through the state tables.
+static std::size_t
+put_octets (decoder_type& d, std::string const& s)
+{
+    std::size_t i = 0;
+    while (i < s.size () && d.line.put (static_cast<uint8_t> (s[i++]), d.req))
+        ;
+    if (d.line.good ())
+        while (i < s.size () && d.header.put (static_cast<uint8_t> (s[i++]), d.req))
+            ;
+    return i;
+}
+
+// the scanner, with the input cut at the given offsets as reads would.
+static std::size_t
+put_spans (decoder_type& d, std::string const& s, std::vector<std::size_t> const& cuts)
+{
+    return test::put_spans (s, cuts,
+        [&] (char const* p, std::size_t const n) {
+            return d.line.partial () ? d.line.put (p, n, d.req) : d.header.put (p, n, d.req);
+        },
+        [&] () { return d.partial (); });
+}
+
+static const std::vector<std::string> SAMPLES {
+    "GET /example.html HTTP/1.1\r\n"
+    "Host: example.net:10080  \r\n"
+    "Connection: close  \r\n"
+    "Accept-Language:   ,ja, en  ,  \r\n"
+    "\r\n",
+
+    "OPTION * HTTP/1.0\r\n"
+    "\r\n",
+
+    "POST /cgi-bin/process.cgi?a=1&b=%7e;c=(x),y:z@w/v?u HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 49\r\n"
+    "X-Folded: first\r\n"
+    " \t second\t \r\n"
+    "X-Folded: again\r\n"
+    "\r\n",
+
+    "M-SEARCH!#$%&'*+.^_`|~ /a_b~c/__init__.py HTTP/1.1\r\n"
+    "Accept:text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=en-US\r\n"
+    "x-empty:\r\n"
+    "x-blank: \t \r\n"
+    "\r\n",
+};
+
+static const std::string NOISE ("\r\n:\t /?%*~|!\"<>[]{}\\^`@=,;()\x7f\x80\xff\x01\0aZ9-._", 39);
+
+void
+test_1 (test::simple& ts)
+{
+    static const http::scan_set_type TCHAR ("!!#'*+-.09AZ^z||");
+    static const http::scan_set_type FIELD ("\t\t ~");
+    std::mt19937 rng (20);
+    bool sse42 = true;
+    bool avx2 = true;
+    for (int round = 0; round < 20000; ++round) {
+        http::scan_set_type const& set = round & 1 ? TCHAR : FIELD;
+        std::string s (rng () % 100, 'a');
+        for (char& c : s)
+            c = 0 == rng () % 50 ? NOISE[rng () % NOISE.size ()] : char (0x21 + rng () % 0x5e);
+        std::size_t const m = http::scan_span_scalar (s.data (), s.size (), set);
+        if (http::scan_has_sse42 ())
+            sse42 = sse42 && m == http::scan_span_sse42 (s.data (), s.size (), set);
+        if (http::scan_has_avx2 ())
+            avx2 = avx2 && m == http::scan_span_avx2 (s.data (), s.size (), set);
+    }
+    if (! http::scan_has_sse42 ())
+        ts.skip ();
+    ts.ok (sse42, "sse4.2 scanner agrees with the scalar one");
+    if (! http::scan_has_avx2 ())
+        ts.skip ();
+    ts.ok (avx2, "avx2 scanner agrees with the scalar one");
+    std::string all;
+    for (int c = 1; c < 256; ++c)
+        all.push_back (c);
+    bool member = true;
+    for (int c = 1; c < 256; ++c)
+        member = member && http::scan_span (all.data () + c - 1, 1, TCHAR) == TCHAR.has (c);
+    ts.ok (member, "scan_span takes exactly the octets of the set");
+}
+
+void
+test_2 (test::simple& ts)
+{
+    std::mt19937 rng (11);
+    int same = 0, total = 0, good = 0;
+    for (int round = 0; round < 40000; ++round) {
+        std::string const s = test::mutate (rng, SAMPLES[rng () % SAMPLES.size ()], NOISE);
+        std::size_t const limit = 0 == rng () % 8 ? 1 + rng () % 64 : 8190;
+        decoder_type reference (limit);
+        decoder_type scanner (limit);
+        std::size_t const n1 = put_octets (reference, s);
+        std::size_t const n2 = put_spans (scanner, s, test::cutpoints (rng, s.size (), 40));
+        ++total;
+        if (n1 == n2 && reference == scanner)
+            ++same;
+        else if (total - same == 1)
+            ts.diag ("differs on: " + test::printable (s));
+        if (reference.header.good ())
+            ++good;
+    }
+    ts.ok (same == total, "bulk put matches octet put on mutated requests");
+    ts.ok (good > total / 10 && good < total, "the fuzz reaches both verdicts");
+    for (std::string const& s : SAMPLES) {
+        decoder_type reference (8190);
+        decoder_type scanner (8190);
+        std::size_t const n1 = put_octets (reference, s);
+        std::size_t const n2 = put_spans (scanner, s + s, std::vector<std::size_t> ());
+        ts.ok (n1 == s.size () && n2 == s.size () && scanner == reference
+                && scanner.header.good (), "stops at the end of the header");
+    }
+}
+
+// cycles per byte of one typical browser request through either path,
+// with the decoders reused as a keep-alive connection does.
+void
+test_3 (test::simple& ts)
+{
+    std::string const s =
+        "GET /static/js/app.3f9a2c1e.bundle.js?v=20240117&lang=en HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+            "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+            "image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Referer: https://www.example.com/articles/2024/01/some-long-title\r\n"
+        "Cookie: sid=6f1c2a9e8b7d4c3f0a1b2c3d4e5f6a7b; theme=dark; tz=Europe%2FBerlin\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    int const rounds = 4000;
+    bool same = true;
+    decoder_type d (8190);
+    std::vector<std::size_t> const whole;
+    uint64_t t0 = test::ticks ();
+    for (int k = 0; k < rounds; ++k) {
+        d.clear ();
+        put_octets (d, s);
+        same = same && d.header.good ();
+    }
+    uint64_t t1 = test::ticks ();
+    for (int k = 0; k < rounds; ++k) {
+        d.clear ();
+        put_spans (d, s, whole);
+        same = same && d.header.good ();
+    }
+    uint64_t t2 = test::ticks ();
+    ts.diag (test::put_rates (t0, t1, t2, double (rounds) * s.size ()));
+    ts.ok (same, "both paths decode the benchmark request");
+}
+
+int
+main ()
+{
+    test::simple ts (10);
+    test_1 (ts);
+    test_2 (ts);
+    test_3 (ts);
+    return ts.done_testing ();
+}
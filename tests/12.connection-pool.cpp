@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <sys/uio.h>
+#include "../server.hpp"
+#include "taptests.hpp"
+
+// the pool must grow without copying a connection, which holds iovecs
+// into its own buffers while a write waits for EAGAIN to clear.
+static_assert (! std::is_copy_constructible<http::connection_type>::value,
+    "connections never relocate");
+
+// a connection in miniature: a queued write that points into itself.
+struct node_type {
+    std::size_t const id;
+    std::size_t prev, next;
+    std::string wrbuf;
+    std::vector<struct iovec> wriov;
+    node_type (std::size_t a, std::size_t b, std::size_t c)
+        : id (a), prev (b), next (c), wrbuf (), wriov () {}
+
+    void queue (std::string const& s)
+    {
+        wrbuf = s;
+        struct iovec const iov = {&wrbuf[0], wrbuf.size ()};
+        wriov.assign (1, iov);
+    }
+
+    bool intact () const
+    {
+        return 1 == wriov.size () && wriov[0].iov_base == wrbuf.data ()
+            && wriov[0].iov_len == wrbuf.size ();
+    }
+
+private:
+    node_type (node_type const&);
+    node_type& operator= (node_type const&);
+};
+
+void
+test_1 (test::simple& ts)
+{
+    enum {FREE, WAIT, CHUNK = 64};
+    http::ring_in_vector<node_type> pool;
+    pool.resize (WAIT + 1);
+    pool.erase (WAIT);
+    std::vector<node_type*> address;
+    bool stable = true;
+    bool queued = true;
+    for (int round = 0; round < 40; ++round) {
+        if (pool.empty (FREE))
+            pool.grow (CHUNK, FREE);
+        while (! pool.empty (FREE)) {
+            std::size_t const id = pool[FREE].next;
+            pool.erase (id);
+            pool.insert (WAIT, id);
+            pool[id].queue (std::string (100 + id, 'a' + id % 26));
+            address.resize (id + 1);
+            address[id] = &pool[id];
+        }
+        for (std::size_t id = WAIT + 1; id < pool.size (); ++id) {
+            stable = stable && address[id] == &pool[id];
+            queued = queued && pool[id].intact ()
+                && pool[id].wrbuf == std::string (100 + id, 'a' + id % 26);
+        }
+    }
+    ts.ok (pool.size () == WAIT + 1 + 40 * CHUNK, "grows a chunk at a time");
+    ts.ok (stable, "live nodes keep their addresses across grows");
+    ts.ok (queued, "queued iovecs still point into their own buffers");
+    std::size_t linked = 0;
+    for (std::size_t id = pool[WAIT].next; id != WAIT; id = pool[id].next)
+        ++linked;
+    ts.ok (linked == 40 * CHUNK && pool.empty (FREE), "every node sits on the wait ring");
+}
+
+int
+main ()
+{
+    test::simple ts (4);
+    test_1 (ts);
+    return ts.done_testing ();
+}
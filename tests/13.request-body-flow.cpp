@@ -0,0 +1,291 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <csignal>
+#include <ctime>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "taptests.hpp"
+
+enum {SPAN = 16384};
+
+// runs the server built next to the tests.  with --test-throttle /test
+// takes at most SPAN octets per 2 msec: a 1 MiB body keeps it behind 64
+// times, which must be spent waiting rather than spinning, as the count
+// of loop passes the server logs at shutdown shows.  bodies a handler
+// will not take are refused before they are read.  with TEST_BIG_UPLOAD
+// set in the environment, a PUT past 4 GiB checks that lengths beyond 32
+// bits go through the decoder and the splice path to the file intact;
+// it writes that much under /tmp, so it is left out by default.
+
+static int
+free_port ()
+{
+    int const s = socket (AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    bind (s, reinterpret_cast<struct sockaddr*> (&addr), len);
+    getsockname (s, reinterpret_cast<struct sockaddr*> (&addr), &len);
+    close (s);
+    return ntohs (addr.sin_port);
+}
+
+static pid_t
+spawn_server (int const port, std::vector<std::string> const& options,
+    std::string const& log = "/dev/null")
+{
+    pid_t const pid = fork ();
+    if (0 == pid) {
+        int const out = open (log.c_str (), O_WRONLY|O_CREAT|O_TRUNC, 0600);
+        dup2 (out, 1);
+        dup2 (out, 2);
+        std::string const p = std::to_string (port);
+        std::vector<char const*> argv {"http-server", "--port", p.c_str ()};
+        for (auto const& x : options)
+            argv.push_back (x.c_str ());
+        argv.push_back (nullptr);
+        execv ("./http-server", const_cast<char* const*> (argv.data ()));
+        _exit (127);
+    }
+    return pid;
+}
+
+static int
+connect_server (int const port)
+{
+    for (int retry = 0; retry < 200; ++retry) {
+        int const s = socket (AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons (port);
+        addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+        if (connect (s, reinterpret_cast<struct sockaddr*> (&addr), sizeof addr) == 0)
+            return s;
+        close (s);
+        usleep (10000);
+    }
+    return -1;
+}
+
+// the passes through its event loop a server has logged at shutdown.
+static long
+logged_passes (std::string const& log)
+{
+    std::ifstream in (log);
+    std::string line;
+    while (std::getline (in, line)) {
+        std::size_t const pos = line.find (", passes ");
+        if (pos != std::string::npos)
+            return std::stol (line.substr (pos + 9));
+    }
+    return -1;
+}
+
+static long
+now_msec ()
+{
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000L + t.tv_nsec / 1000000;
+}
+
+static void
+send_all (int const s, std::string const& request)
+{
+    std::size_t pos = 0;
+    while (pos < request.size ()) {
+        ssize_t const n = write (s, request.data () + pos, request.size () - pos);
+        if (n <= 0)
+            break;
+        pos += n;
+    }
+}
+
+static std::string
+receive_all (int const s)
+{
+    std::string response;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read (s, buf, sizeof buf)) > 0)
+        response.append (buf, n);
+    return response;
+}
+
+static std::string
+exchange (int const s, std::string const& request)
+{
+    send_all (s, request);
+    return receive_all (s);
+}
+
+static std::string
+chunked (std::string const& payload)
+{
+    std::string s;
+    for (std::size_t i = 0; i < payload.size (); i += 50000) {
+        std::string const part = payload.substr (i, 50000);
+        std::ostringstream size;
+        size << std::hex << part.size ();
+        s += size.str () + "\r\n" + part + "\r\n";
+    }
+    return s + "0\r\n\r\n";
+}
+
+void
+test_1 (test::simple& ts, char const* mplex)
+{
+    std::string payload;
+    for (int i = 0; i < 1 << 20; ++i)
+        payload.push_back ('a' + i % 26);
+    char log[] = "/tmp/request-body-flow-log.XXXXXX";
+    int const fd = mkstemp (log);
+    if (fd >= 0)
+        close (fd);
+    int const port = free_port ();
+    pid_t const pid = spawn_server (port,
+        {"--mplex", mplex, "--test-throttle", std::to_string (SPAN)}, log);
+    std::string const name = std::string (" (") + mplex + ")";
+    for (int k = 0; k < 2; ++k) {
+        std::string const request = 0 == k
+            ? "POST /test HTTP/1.1\r\nHost: t\r\nConnection: close\r\n"
+              "Content-Length: " + std::to_string (payload.size ()) + "\r\n\r\n" + payload
+            : "POST /test HTTP/1.1\r\nHost: t\r\nConnection: close\r\n"
+              "Transfer-Encoding: chunked\r\n\r\n" + chunked (payload);
+        std::string const kind = 0 == k ? "content-length body" : "chunked body";
+        int const s = connect_server (port);
+        long const t0 = now_msec ();
+        std::string const response = s < 0 ? "" : exchange (s, request);
+        long const t1 = now_msec ();
+        if (s >= 0)
+            close (s);
+        ts.diag (kind + name + ": " + std::to_string (t1 - t0) + " msec");
+        ts.ok (response.compare (0, 15, "HTTP/1.1 200 OK") == 0
+            && response.find ("<pre>" + payload + "</pre>") != std::string::npos,
+            "a slow handler gets the whole " + kind + name);
+    }
+    kill (pid, SIGINT);
+    waitpid (pid, nullptr, 0);
+    // each of the 2 * 64 stalls costs a few passes; a server that spun
+    // while the handler was behind would run thousands per stall.
+    long const passes = logged_passes (log);
+    unlink (log);
+    ts.diag ("loop passes" + name + ": " + std::to_string (passes));
+    ts.ok (0 < passes && passes < 2 * (1 << 20) / SPAN * 16,
+        "the server waits for it without spinning" + name);
+}
+
+// the body is a sparse file with a marker at each end, sent with
+// sendfile, so only the server's copy costs real blocks.
+void
+test_2 (test::simple& ts)
+{
+    if (nullptr == getenv ("TEST_BIG_UPLOAD")) {
+        ts.skip ();
+        ts.ok (true, "PUT past 4 GiB, set TEST_BIG_UPLOAD to run");
+        ts.skip ();
+        ts.ok (true, "the stored file keeps its length and both ends");
+        return;
+    }
+    off_t const size = (off_t (1) << 32) + 16;
+    char dir[] = "/tmp/request-body-flow.XXXXXX";
+    char body[] = "/tmp/request-body-flow-body.XXXXXX";
+    if (nullptr == mkdtemp (dir)) {
+        ts.ok (false, "PUT past 4 GiB");
+        ts.ok (false, "the stored file keeps its length and both ends");
+        return;
+    }
+    int const fd = mkstemp (body);
+    unlink (body);
+    bool const made = fd >= 0 && ftruncate (fd, size) == 0
+        && pwrite (fd, "head", 4, 0) == 4 && pwrite (fd, "tail", 4, size - 4) == 4;
+    int const port = free_port ();
+    pid_t const pid = spawn_server (port, {"--upload-dir", dir});
+    int const s = connect_server (port);
+    std::string response;
+    if (made && s >= 0) {
+        send_all (s, "PUT /big.bin HTTP/1.1\r\nHost: t\r\nConnection: close\r\n"
+            "Content-Length: " + std::to_string (size) + "\r\n\r\n");
+        off_t offset = 0;
+        while (offset < size && sendfile (s, fd, &offset, size - offset) > 0)
+            ;
+        response = receive_all (s);
+    }
+    if (s >= 0)
+        close (s);
+    if (fd >= 0)
+        close (fd);
+    kill (pid, SIGINT);
+    waitpid (pid, nullptr, 0);
+    ts.ok (response.compare (0, 20, "HTTP/1.1 201 Created") == 0, "PUT past 4 GiB");
+    std::string const path = std::string (dir) + "/big.bin";
+    struct stat st;
+    char head[4] = {0}, tail[4] = {0};
+    int const got = open (path.c_str (), O_RDONLY);
+    bool const kept = got >= 0 && fstat (got, &st) == 0 && st.st_size == size
+        && pread (got, head, 4, 0) == 4 && pread (got, tail, 4, size - 4) == 4
+        && std::string (head, 4) == "head" && std::string (tail, 4) == "tail";
+    if (got >= 0)
+        close (got);
+    unlink (path.c_str ());
+    rmdir (dir);
+    ts.ok (kept, "the stored file keeps its length and both ends");
+}
+
+// no body is sent past the headers: a refusal must come without it.
+static std::string
+status_of (int const port, std::string const& request)
+{
+    int const s = connect_server (port);
+    if (s < 0)
+        return "";
+    std::string const response = exchange (s, request);
+    close (s);
+    return response.substr (0, response.find ("\r\n"));
+}
+
+void
+test_3 (test::simple& ts)
+{
+    int const port = free_port ();
+    pid_t const pid = spawn_server (port, {"--max-body", "1000"});
+    std::string const post = "POST /test HTTP/1.1\r\nHost: t\r\nConnection: close\r\n";
+    ts.ok (status_of (port, "POST /index.html HTTP/1.1\r\nHost: t\r\n"
+            "Content-Length: 1000000000\r\n\r\n") == "HTTP/1.1 405 Method Not Allowed",
+        "a static path refuses a POST body unread");
+    ts.ok (status_of (port, "PUT /put.txt HTTP/1.1\r\nHost: t\r\n"
+            "Content-Length: 5\r\n\r\n") == "HTTP/1.1 405 Method Not Allowed",
+        "PUT is refused without --upload-dir");
+    ts.ok (status_of (port, post + "Content-Length: 1001\r\n\r\n")
+            == "HTTP/1.1 413 Request Entity Too Large",
+        "a Content-Length past --max-body is refused unread");
+    ts.ok (status_of (port, post + "Transfer-Encoding: chunked\r\n\r\n"
+            + chunked (std::string (2000, 'x'))) == "HTTP/1.1 413 Request Entity Too Large",
+        "a chunked body is refused once it grows past --max-body");
+    ts.ok (status_of (port, post + "Content-Length: 1000\r\n\r\n" + std::string (1000, 'x'))
+            == "HTTP/1.1 200 OK",
+        "a body of --max-body octets is taken");
+    kill (pid, SIGINT);
+    waitpid (pid, nullptr, 0);
+}
+
+int
+main ()
+{
+    test::simple ts (13);
+    test_1 (ts, "epoll");
+    test_1 (ts, "uring");
+    test_2 (ts);
+    test_3 (ts);
+    return ts.done_testing ();
+}
@@ -0,0 +1,115 @@
+#ifndef TESTS_DECODE_FUZZ_HPP
+#define TESTS_DECODE_FUZZ_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+#include <sstream>
+#include <time.h>
+
+// helpers for the tests that hold a decoder's bulk put against its
+// octet put: random edits of valid input, random cuts as reads would
+// leave it, and a clock for the benchmarks.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+namespace test {
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static inline uint64_t ticks () { return __rdtsc (); }
+static char const* const TICKS = "cycles";
+#else
+static inline uint64_t
+ticks ()
+{
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return uint64_t (t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+static char const* const TICKS = "nsec";
+#endif
+
+// up to three edits, each an octet of noise, or now and then any octet,
+// put in place of one, inserted or erased, or a run of up to 47 copies
+// of an octet already there.
+static inline std::string
+mutate (std::mt19937& rng, std::string s, std::string const& noise)
+{
+    int const edits = rng () % 4;
+    for (int k = 0; k < edits && ! s.empty (); ++k) {
+        std::size_t const pos = rng () % s.size ();
+        char const c = 0 == rng () % 4 ? char (rng ()) : noise[rng () % noise.size ()];
+        switch (rng () % 4) {
+        case 0: s[pos] = c; break;
+        case 1: s.insert (pos, 1, c); break;
+        case 2: s.erase (pos, 1); break;
+        case 3: s.insert (pos, std::string (rng () % 48, s[pos])); break;
+        }
+    }
+    return s;
+}
+
+// offsets that cut n octets into pieces of 1 to max octets.
+static inline std::vector<std::size_t>
+cutpoints (std::mt19937& rng, std::size_t const n, std::size_t const max)
+{
+    std::vector<std::size_t> cuts;
+    std::size_t pos = 0;
+    while (n > 0 && (pos += 1 + rng () % max) < n)
+        cuts.push_back (pos);
+    return cuts;
+}
+
+// feeds s to put (p, n), which returns how many octets it took, piece
+// by piece between the cuts while partial () holds.  returns the octets
+// taken in all.
+template<class PUT, class PARTIAL>
+std::size_t
+put_spans (std::string const& s, std::vector<std::size_t> const& cuts, PUT put, PARTIAL partial)
+{
+    std::size_t i = 0;
+    for (std::size_t k = 0; k <= cuts.size () && partial (); ++k) {
+        std::size_t const e = k < cuts.size () ? cuts[k] : s.size ();
+        while (i < e && partial ())
+            i += put (s.data () + i, e - i);
+    }
+    return i;
+}
+
+// s with the octets outside printable ascii, and backslash, as \xHH.
+static inline std::string
+printable (std::string const& s)
+{
+    static const char HEX[] = "0123456789abcdef";
+    std::string t;
+    for (char c : s) {
+        uint8_t const u = c;
+        if (0x20 <= u && u < 0x7f && '\\' != u)
+            t.push_back (c);
+        else {
+            t += "\\x";
+            t.push_back (HEX[u >> 4]);
+            t.push_back (HEX[u & 15]);
+        }
+    }
+    return t;
+}
+
+// the benchmark line for the octet put timed from t0 to t1 and the bulk
+// put from t1 to t2, both over the same number of octets.
+static inline std::string
+put_rates (uint64_t const t0, uint64_t const t1, uint64_t const t2, double const octets)
+{
+    std::ostringstream os;
+    os.precision (3);
+    os << "octet put " << (t1 - t0) / octets << " " << TICKS << "/byte, "
+       << "bulk put " << (t2 - t1) / octets << " " << TICKS << "/byte";
+    return os.str ();
+}
+
+}//namespace test
+
+#endif
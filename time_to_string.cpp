@@ -30,13 +30,12 @@ time_to_string (std::string const& fmt, std::time_t epoch)
 {
     static const std::string a ("Sun Mon Tue Wed Thu Fri Sat ");
     static const std::string b ("Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec ");
-    struct tm* p;
+    struct tm dt;
     if (fmt.find (" GMT") != std::string::npos
             || fmt.find (" UTC") != std::string::npos)
-        p = std::gmtime (&epoch);
+        gmtime_r (&epoch, &dt);
     else
-        p = std::localtime (&epoch);
-    struct tm dt = *p;
+        localtime_r (&epoch, &dt);
     char zone[8];
     char const zonefmt[] = "%z";
     std::strftime (zone, sizeof zone, zonefmt, &dt);
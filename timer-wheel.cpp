@@ -0,0 +1,272 @@
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "server.hpp"
+
+namespace http {
+
+// hierarchical timing wheel after the classic kernel timer vectors.
+//
+// root: ROOT_SIZE slots, one per tick within the next ROOT_SIZE ticks.
+// level 1 .. LEVELS-1: NODE_SIZE slots each, covering ranges
+//   ROOT_SIZE * NODE_SIZE^(level-1) ticks per slot.
+// every time the root index wraps around to zero, the current slot of
+// the next level is cascaded down into the lower levels.
+//
+// links are intrusive: node k < HEADS is a slot head (or the expired
+// list), node HEADS + id belongs to the timer id.
+//
+// a bit per slot marks the occupied ones, and the earliest expiry held
+// in the upper levels is kept until the timer holding it leaves, so
+// that next_expiry () is the true earliest deadline without a walk over
+// the slots.  cascades then happen lazily, when advance () gets there.
+
+static_assert (timer_wheel_type::NODE_SIZE == 64, "an upper level fills one word of slot bits");
+
+// the horizon: a timer further out sits in the last slot until a
+// cascade brings it nearer.
+static const int64_t MAX_DELTA
+    = (int64_t (1) << (timer_wheel_type::ROOT_BITS
+        + (timer_wheel_type::LEVELS - 1) * timer_wheel_type::NODE_BITS)) - 1;
+
+timer_wheel_type::timer_wheel_type ()
+    : current (0), prev (), next (), expires (),
+      upper_min (std::numeric_limits<int64_t>::max ()), upper_known (true)
+{
+    resize (0);
+    reset (0);
+}
+
+void
+timer_wheel_type::resize (std::size_t const n)
+{
+    std::size_t const m = prev.size ();
+    for (std::size_t i = m; i < HEADS + n; ++i) {
+        prev.push_back (i);
+        next.push_back (i);
+    }
+    expires.resize (n, 0);
+}
+
+void
+timer_wheel_type::reset (int64_t const tick)
+{
+    for (std::size_t i = 0; i < prev.size (); ++i) {
+        prev[i] = i;
+        next[i] = i;
+    }
+    for (std::size_t w = 0; w < WORDS; ++w)
+        occupied[w] = 0;
+    upper_min = std::numeric_limits<int64_t>::max ();
+    upper_known = true;
+    current = tick;
+}
+
+bool
+timer_wheel_type::linked (std::size_t const id) const
+{
+    std::size_t const k = HEADS + id;
+    return k < next.size () && next[k] != k;
+}
+
+void
+timer_wheel_type::link (std::size_t const head, std::size_t const k)
+{
+    prev[k] = prev[head];
+    next[k] = head;
+    next[prev[k]] = k;
+    prev[head] = k;
+    if (head < SLOTS)
+        occupied[head >> 6] |= uint64_t (1) << (head & 63);
+    if (ROOT_SIZE <= head && head < SLOTS && expires[k - HEADS] < upper_min) {
+        if (expires[k - HEADS] - current < MAX_DELTA)
+            upper_min = expires[k - HEADS];
+        else
+            upper_known = false;
+    }
+}
+
+void
+timer_wheel_type::unlink (std::size_t const k)
+{
+    std::size_t const p = prev[k];
+    std::size_t const n = next[k];
+    next[p] = n;
+    prev[n] = p;
+    prev[k] = k;
+    next[k] = k;
+    if (p == n && p < SLOTS)
+        occupied[p >> 6] &= ~(uint64_t (1) << (p & 63));
+    if (expires[k - HEADS] == upper_min)
+        upper_known = false;
+}
+
+void
+timer_wheel_type::insert (std::size_t const id, int64_t const tick)
+{
+    if (HEADS + id >= next.size ())
+        resize (id + 1);
+    erase (id);
+    expires[id] = tick;
+    place (id);
+}
+
+void
+timer_wheel_type::erase (std::size_t const id)
+{
+    if (linked (id))
+        unlink (HEADS + id);
+}
+
+void
+timer_wheel_type::place (std::size_t const id)
+{
+    int64_t const delta = expires[id] - current;
+    std::size_t head;
+    if (delta < 0)
+        head = current & ROOT_MASK;
+    else if (delta < ROOT_SIZE)
+        head = expires[id] & ROOT_MASK;
+    else {
+        int64_t const tick = delta < MAX_DELTA ? expires[id] : current + MAX_DELTA;
+        int level = 1;
+        int shift = ROOT_BITS;
+        while (level < LEVELS - 1 && delta >= (int64_t (1) << (shift + NODE_BITS))) {
+            ++level;
+            shift += NODE_BITS;
+        }
+        head = ROOT_SIZE + (level - 1) * NODE_SIZE + ((tick >> shift) & NODE_MASK);
+    }
+    link (head, HEADS + id);
+}
+
+bool
+timer_wheel_type::cascade (int const level)
+{
+    int const shift = ROOT_BITS + (level - 1) * NODE_BITS;
+    std::size_t const index = (current >> shift) & NODE_MASK;
+    std::size_t const head = ROOT_SIZE + (level - 1) * NODE_SIZE + index;
+    while (! empty (head)) {
+        std::size_t const k = next[head];
+        unlink (k);
+        place (k - HEADS);
+    }
+    return 0 == index;
+}
+
+void
+timer_wheel_type::step ()
+{
+    std::size_t const index = current & ROOT_MASK;
+    if (0 == index) {
+        for (int level = 1; level < LEVELS; ++level)
+            if (! cascade (level))
+                break;
+    }
+    while (! empty (index)) {
+        std::size_t const k = next[index];
+        unlink (k);
+        link (EXPIRED, k);
+    }
+    ++current;
+}
+
+void
+timer_wheel_type::advance (int64_t const tick)
+{
+    while (current <= tick) {
+        std::size_t const index = current & ROOT_MASK;
+        if (0 == index || ! empty (index))
+            step ();
+        else {
+            int64_t const expiry = next_step ();
+            current = expiry > tick ? tick + 1 : expiry;
+        }
+    }
+}
+
+std::size_t
+timer_wheel_type::pop_expired ()
+{
+    std::size_t const k = next[EXPIRED];
+    if (EXPIRED == k)
+        return std::numeric_limits<std::size_t>::max ();
+    unlink (k);
+    return k - HEADS;
+}
+
+// the tick of the first occupied root slot from the current one on.  a
+// root slot holds the timers of exactly one tick, or overdue ones in
+// the current slot.
+int64_t
+timer_wheel_type::root_expiry () const
+{
+    std::size_t const start = current & ROOT_MASK;
+    uint64_t const below = (uint64_t (1) << (start & 63)) - 1;
+    for (std::size_t i = 0; i <= ROOT_WORDS; ++i) {
+        std::size_t const w = ((start >> 6) + i) % ROOT_WORDS;
+        uint64_t bits = occupied[w];
+        if (0 == i)
+            bits &= ~below;
+        else if (ROOT_WORDS == i)
+            bits &= below;
+        if (0 != bits) {
+            std::size_t const index = w * 64 + __builtin_ctzll (bits);
+            return current + ((index - start) & ROOT_MASK);
+        }
+    }
+    return std::numeric_limits<int64_t>::max ();
+}
+
+// the earliest expiry in the upper levels.  the slots of a level come
+// due in turn from the one after its current index, or from that one
+// while current sits on the boundary that cascades it, so only the first
+// occupied slot of each level has to be looked through.  a timer past
+// the horizon counts as due at the end of its slot, when the cascade
+// that moves it on happens.  no upper timer lies behind current, so a
+// kept value that does has gone stale.
+int64_t
+timer_wheel_type::upper_expiry () const
+{
+    if (upper_known && upper_min >= current)
+        return upper_min;
+    upper_min = std::numeric_limits<int64_t>::max ();
+    for (int level = 1; level < LEVELS; ++level) {
+        uint64_t const bits = occupied[ROOT_WORDS + level - 1];
+        if (0 == bits)
+            continue;
+        int const shift = ROOT_BITS + (level - 1) * NODE_BITS;
+        int64_t const base = (current - 1) >> shift;
+        unsigned const start = (base + 1) & NODE_MASK;
+        uint64_t const turned = 0 == start ? bits : bits >> start | bits << (64 - start);
+        int const distance = 1 + __builtin_ctzll (turned);
+        std::size_t const head = ROOT_SIZE + (level - 1) * NODE_SIZE
+            + ((start + distance - 1) & NODE_MASK);
+        int64_t const end = (base + distance + 1) << shift;
+        for (std::size_t k = next[head]; k != head; k = next[k])
+            upper_min = std::min (upper_min, std::min (expires[k - HEADS], end));
+    }
+    upper_known = true;
+    return upper_min;
+}
+
+// the earliest tick at which step () has something to do: either a root
+// slot holding timers or the next cascade boundary while upper levels
+// hold any.
+int64_t
+timer_wheel_type::next_step () const
+{
+    int64_t const tick = root_expiry ();
+    for (int level = 1; level < LEVELS; ++level)
+        if (0 != occupied[ROOT_WORDS + level - 1])
+            return std::min (tick, (current | ROOT_MASK) + 1);
+    return tick;
+}
+
+int64_t
+timer_wheel_type::next_expiry () const
+{
+    return std::min (root_expiry (), upper_expiry ());
+}
+
+}//namespace http